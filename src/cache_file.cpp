@@ -0,0 +1,116 @@
+/*
+ * This file part of sdcv - console version of Stardict program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache_file.hpp"
+
+std::list<std::string> CacheFile::get_variants(const std::string &url, const std::string &suffix)
+{
+    std::list<std::string> res = { url + suffix };
+    // dictionaries can be loaded at once, so directory could be just created by other thread
+    if (!g_file_test(g_get_user_cache_dir(), G_FILE_TEST_EXISTS) && g_mkdir(g_get_user_cache_dir(), 0700) == -1
+        && errno != EEXIST)
+        return res;
+
+    const std::string cache_dir = std::string(g_get_user_cache_dir()) + G_DIR_SEPARATOR_S + "sdcv";
+
+    if (!g_file_test(cache_dir.c_str(), G_FILE_TEST_EXISTS)) {
+        if (g_mkdir(cache_dir.c_str(), 0700) == -1 && errno != EEXIST)
+            return res;
+    } else if (!g_file_test(cache_dir.c_str(), G_FILE_TEST_IS_DIR))
+        return res;
+
+    gchar *base = g_path_get_basename(url.c_str());
+    res.push_back(cache_dir + G_DIR_SEPARATOR_S + base + suffix);
+    g_free(base);
+    return res;
+}
+
+bool CacheFile::load(const std::string &url, const std::string &suffix, const std::string &magic,
+                     const std::list<std::string> &sources)
+{
+    const std::list<std::string> vars = get_variants(url, suffix);
+    time_t sources_mtime = 0;
+    std::list<std::string> all_sources = sources;
+    all_sources.push_front(url);
+    for (const std::string &source : all_sources) {
+        struct ::stat srcstat;
+        if (g_stat(source.c_str(), &srcstat) != 0)
+            return false;
+        sources_mtime = std::max(sources_mtime, srcstat.st_mtime);
+    }
+
+    for (const std::string &item : vars) {
+        struct ::stat cachestat;
+        if (g_stat(item.c_str(), &cachestat) != 0)
+            continue;
+        if (cachestat.st_mtime < sources_mtime)
+            continue;
+        if (cachestat.st_size < static_cast<off_t>(magic.size()))
+            continue;
+        if (!mapfile_.open(item.c_str(), cachestat.st_size))
+            continue;
+        if (memcmp(mapfile_.begin(), magic.data(), magic.size()) != 0) {
+            mapfile_.close();
+            continue;
+        }
+        magic_len_ = magic.size();
+        size_ = cachestat.st_size - magic.size();
+        return true;
+    }
+
+    return false;
+}
+
+bool CacheFile::save(const std::string &url, const std::string &suffix, const std::string &magic,
+                     const std::function<bool(FILE *)> &writer)
+{
+    const std::list<std::string> vars = get_variants(url, suffix);
+    for (const std::string &item : vars) {
+        std::string tmp_name = item + ".XXXXXX";
+        // the same permissions as fopen would give
+        const int fd = g_mkstemp_full(&tmp_name[0], O_WRONLY, 0666);
+        if (fd == -1)
+            continue;
+        FILE *out = fdopen(fd, "wb");
+        if (!out) {
+            close(fd);
+            g_unlink(tmp_name.c_str());
+            continue;
+        }
+        const bool ok = fwrite(magic.data(), 1, magic.size(), out) == magic.size() && writer(out);
+        if (fclose(out) != 0 || !ok || g_rename(tmp_name.c_str(), item.c_str()) != 0) {
+            g_unlink(tmp_name.c_str());
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <list>
+#include <string>
+
+#include "mapfile.hpp"
+
+//cache of data calculated from some file, it is stored near the file
+//or in user cache directory and is not used after the file was modified
+class CacheFile
+{
+public:
+    CacheFile() {}
+    CacheFile(const CacheFile &) = delete;
+    CacheFile &operator=(const CacheFile &) = delete;
+
+    //possible places of cache for url, in order of preference
+    static std::list<std::string> get_variants(const std::string &url, const std::string &suffix);
+
+    //map the first cache which is not older than url and other sources, and starts with magic
+    bool load(const std::string &url, const std::string &suffix, const std::string &magic,
+              const std::list<std::string> &sources = std::list<std::string>());
+    //data after magic
+    const gchar *data() { return mapfile_.begin() + magic_len_; }
+    size_t size() const { return size_; }
+
+    //write magic and everything written by writer to the first possible place,
+    //file is replaced atomically, so nobody can read half written cache
+    static bool save(const std::string &url, const std::string &suffix, const std::string &magic,
+                     const std::function<bool(FILE *)> &writer);
+
+private:
+    MapFile mapfile_;
+    size_t magic_len_ = 0;
+    size_t size_ = 0;
+};
@@ -0,0 +1,98 @@
+/*
+ * This file part of sdcv - console version of Stardict program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "chunk_cache.hpp"
+
+ChunkCache &ChunkCache::instance()
+{
+    static ChunkCache cache;
+    return cache;
+}
+
+void ChunkCache::set_capacity(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.capacity = capacity;
+    shrink(capacity);
+}
+
+ChunkCache::Chunk ChunkCache::get(guint64 owner, guint32 chunk)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = items_.find({ owner, chunk });
+    if (it == items_.end()) {
+        ++stats_.misses;
+        return nullptr;
+    }
+    ++stats_.hits;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->second;
+}
+
+void ChunkCache::put(guint64 owner, guint32 chunk, Chunk data)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (data->size() > stats_.capacity)
+        return;
+    const Key key = { owner, chunk };
+    // other thread could inflate the same chunk meanwhile
+    if (items_.count(key))
+        return;
+    shrink(stats_.capacity - data->size());
+    stats_.size += data->size();
+    lru_.emplace_front(key, std::move(data));
+    items_[key] = lru_.begin();
+}
+
+void ChunkCache::drop(guint64 owner)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = lru_.begin(); it != lru_.end();) {
+        if (it->first.owner == owner) {
+            stats_.size -= it->second->size();
+            items_.erase(it->first);
+            it = lru_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+ChunkCache::Stats ChunkCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats res = stats_;
+    res.nchunks = items_.size();
+    return res;
+}
+
+// drop the least recently used chunks until size is not above capacity
+void ChunkCache::shrink(size_t capacity)
+{
+    while (stats_.size > capacity) {
+        const Item &item = lru_.back();
+        stats_.size -= item.second->size();
+        items_.erase(item.first);
+        lru_.pop_back();
+        ++stats_.evictions;
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <glib.h>
+
+//inflated chunks of all dictzip files, the least recently used
+//chunks are dropped when their total size is above capacity
+class ChunkCache
+{
+public:
+    using Chunk = std::shared_ptr<const std::vector<char>>;
+    struct Stats {
+        guint64 hits = 0;
+        guint64 misses = 0;
+        guint64 evictions = 0;
+        size_t nchunks = 0;
+        size_t size = 0;
+        size_t capacity = 0;
+    };
+
+    static const size_t DEFAULT_CAPACITY = 16 * 1024 * 1024;
+
+    ChunkCache(const ChunkCache &) = delete;
+    ChunkCache &operator=(const ChunkCache &) = delete;
+
+    //cache shared by all files
+    static ChunkCache &instance();
+
+    void set_capacity(size_t capacity);
+    //owner is unique id of file, returns nullptr if chunk is not cached
+    Chunk get(guint64 owner, guint32 chunk);
+    void put(guint64 owner, guint32 chunk, Chunk data);
+    //forget all chunks of closed file
+    void drop(guint64 owner);
+    Stats stats() const;
+
+private:
+    struct Key {
+        guint64 owner;
+        guint32 chunk;
+        bool operator==(const Key &rh) const { return owner == rh.owner && chunk == rh.chunk; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key &key) const { return std::hash<guint64>()(key.owner * 0x9e3779b97f4a7c15ULL + key.chunk); }
+    };
+    using Item = std::pair<Key, Chunk>;
+
+    mutable std::mutex mutex_;
+    //the most recently used chunks are at the front
+    std::list<Item> lru_;
+    std::unordered_map<Key, std::list<Item>::iterator, KeyHash> items_;
+    Stats stats_;
+
+    ChunkCache() { stats_.capacity = DEFAULT_CAPACITY; }
+    void shrink(size_t capacity);
+};
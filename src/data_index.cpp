@@ -0,0 +1,230 @@
+/*
+ * This file part of sdcv - console version of Stardict program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "stardict_lib.hpp"
+
+#include "data_index.hpp"
+
+namespace
+{
+const char DATA_INDEX_MAGIC[] = "sdcv data index, version: 1\n";
+// header: number of articles, number of tokens, size of postings, size of tokens
+const size_t HEADER_SIZE = 4 * sizeof(guint32);
+
+void append_uint32(std::vector<gchar> &buf, guint32 val)
+{
+    const size_t pos = buf.size();
+    buf.resize(pos + sizeof(guint32));
+    set_uint32(&buf[pos], val);
+}
+
+// 7 bits in every byte, the high bit is set in all bytes except the last one
+void append_varint(std::string &buf, guint32 val)
+{
+    while (val >= 0x80) {
+        buf += gchar((val & 0x7f) | 0x80);
+        val >>= 7;
+    }
+    buf += gchar(val);
+}
+
+template <typename Fn>
+void for_each_token(const gchar *text, size_t len, Fn fn)
+{
+    const gchar *end = text + len;
+    const gchar *p = text;
+    while (p < end) {
+        while (p < end && DataIndex::is_separator(*p))
+            ++p;
+        const gchar *token = p;
+        while (p < end && !DataIndex::is_separator(*p))
+            ++p;
+        if (p > token)
+            fn(token, p - token);
+    }
+}
+} // namespace
+
+void DataIndex::Builder::add(glong idx, const gchar *text, size_t len)
+{
+    for_each_token(text, len, [this, idx](const gchar *token, size_t token_len) {
+        std::vector<guint32> &articles = postings_[std::string(token, token_len)];
+        // article is added by all its fields one after another
+        if (articles.empty() || articles.back() != guint32(idx))
+            articles.push_back(idx);
+    });
+}
+
+bool DataIndex::load(const std::string &url, const std::list<std::string> &sources, glong wordcount,
+                     const std::function<void(Builder &)> &fill)
+{
+    const std::string magic(DATA_INDEX_MAGIC);
+    if (cache_.load(url, ".dti", magic, sources) && attach(cache_.data(), cache_.size(), wordcount))
+        return true;
+
+    build(wordcount, fill, buffer_);
+    CacheFile::save(url, ".dti", magic, [this](FILE *out) {
+        return fwrite(&buffer_[0], 1, buffer_.size(), out) == buffer_.size();
+    });
+    return attach(&buffer_[0], buffer_.size(), wordcount);
+}
+
+void DataIndex::build(glong wordcount, const std::function<void(Builder &)> &fill, std::vector<gchar> &buf)
+{
+    Builder builder;
+    fill(builder);
+
+    std::vector<std::pair<std::string, std::vector<guint32>>> tokens(
+        std::make_move_iterator(builder.postings_.begin()), std::make_move_iterator(builder.postings_.end()));
+    builder.postings_.clear();
+    std::sort(tokens.begin(), tokens.end());
+
+    std::vector<guint32> token_offsets, posting_offsets;
+    std::string token_data, posting_data;
+    for (auto &token : tokens) {
+        token_offsets.push_back(token_data.size());
+        posting_offsets.push_back(posting_data.size());
+        token_data.append(token.first.c_str(), token.first.size() + 1);
+        // articles are not read in order of indexes
+        std::vector<guint32> &articles = token.second;
+        std::sort(articles.begin(), articles.end());
+        articles.erase(std::unique(articles.begin(), articles.end()), articles.end());
+        guint32 prev = 0;
+        for (guint32 idx : articles) {
+            append_varint(posting_data, idx - prev);
+            prev = idx;
+        }
+    }
+    token_offsets.push_back(token_data.size());
+    posting_offsets.push_back(posting_data.size());
+
+    buf.clear();
+    append_uint32(buf, wordcount);
+    append_uint32(buf, tokens.size());
+    append_uint32(buf, posting_data.size());
+    append_uint32(buf, token_data.size());
+    for (guint32 off : token_offsets)
+        append_uint32(buf, off);
+    for (guint32 off : posting_offsets)
+        append_uint32(buf, off);
+    buf.insert(buf.end(), posting_data.begin(), posting_data.end());
+    buf.insert(buf.end(), token_data.begin(), token_data.end());
+}
+
+bool DataIndex::attach(const gchar *data, size_t size, glong wordcount)
+{
+    if (size < HEADER_SIZE)
+        return false;
+    const guint32 nwords = get_uint32(data);
+    const guint32 ntokens = get_uint32(data + sizeof(guint32));
+    const guint32 postings_size = get_uint32(data + 2 * sizeof(guint32));
+    const guint32 tokens_size = get_uint32(data + 3 * sizeof(guint32));
+    if (nwords != guint32(wordcount)
+        || size != HEADER_SIZE + 2 * (guint64(ntokens) + 1) * sizeof(guint32) + guint64(postings_size) + tokens_size)
+        return false;
+
+    const gchar *token_offsets = data + HEADER_SIZE;
+    const gchar *posting_offsets = token_offsets + (guint64(ntokens) + 1) * sizeof(guint32);
+    const gchar *tokens = posting_offsets + (guint64(ntokens) + 1) * sizeof(guint32) + postings_size;
+    // tokens and their postings follow each other, every token is not empty and ends with '\0'
+    if (get_uint32(token_offsets) != 0 || get_uint32(token_offsets + ntokens * sizeof(guint32)) != tokens_size
+        || get_uint32(posting_offsets) != 0 || get_uint32(posting_offsets + ntokens * sizeof(guint32)) != postings_size)
+        return false;
+    for (guint32 i = 0; i < ntokens; ++i) {
+        const guint32 token_begin = get_uint32(token_offsets + i * sizeof(guint32));
+        const guint32 token_end = get_uint32(token_offsets + (i + 1) * sizeof(guint32));
+        if (token_end <= token_begin + guint64(1) || token_end > tokens_size || tokens[token_end - 1] != '\0'
+            || get_uint32(posting_offsets + i * sizeof(guint32)) > get_uint32(posting_offsets + (i + 1) * sizeof(guint32)))
+            return false;
+    }
+
+    nwords_ = nwords;
+    ntokens_ = ntokens;
+    token_offsets_ = token_offsets;
+    posting_offsets_ = posting_offsets;
+    postings_ = reinterpret_cast<const guint8 *>(posting_offsets_ + (ntokens_ + 1) * sizeof(guint32));
+    tokens_ = tokens;
+    return true;
+}
+
+// union of articles of all tokens which contain piece
+void DataIndex::find_articles(const std::string &piece, std::vector<glong> &idxs) const
+{
+    idxs.clear();
+    for (guint32 i = 0; i < ntokens_; ++i) {
+        const guint32 token_begin = get_uint32(token_offsets_ + i * sizeof(guint32));
+        const guint32 token_end = get_uint32(token_offsets_ + (i + 1) * sizeof(guint32)) - 1;
+        if (token_end - token_begin < piece.size()
+            || !memmem(tokens_ + token_begin, token_end - token_begin, piece.data(), piece.size()))
+            continue;
+
+        const guint8 *p = postings_ + get_uint32(posting_offsets_ + i * sizeof(guint32));
+        const guint8 *end = postings_ + get_uint32(posting_offsets_ + (i + 1) * sizeof(guint32));
+        guint64 idx = 0;
+        while (p < end) {
+            guint64 delta = 0;
+            for (int shift = 0; p < end && shift < 64; shift += 7) {
+                delta |= guint64(*p & 0x7f) << shift;
+                if (!(*p++ & 0x80))
+                    break;
+            }
+            idx += delta;
+            // cache is broken, but only existing articles are given
+            if (idx >= nwords_)
+                break;
+            idxs.push_back(idx);
+        }
+    }
+    std::sort(idxs.begin(), idxs.end());
+    idxs.erase(std::unique(idxs.begin(), idxs.end()), idxs.end());
+}
+
+bool DataIndex::lookup(const std::vector<std::string> &words, std::vector<glong> &idxs) const
+{
+    // every part of word between separators is inside of some token of article
+    std::vector<std::string> pieces;
+    for (const std::string &word : words)
+        for_each_token(word.data(), word.size(), [&pieces](const gchar *token, size_t len) {
+            pieces.emplace_back(token, len);
+        });
+    if (pieces.empty())
+        return false;
+    // long pieces are contained in less tokens
+    std::sort(pieces.begin(), pieces.end(), [](const std::string &lh, const std::string &rh) {
+        return lh.size() > rh.size() || (lh.size() == rh.size() && lh < rh);
+    });
+    pieces.erase(std::unique(pieces.begin(), pieces.end()), pieces.end());
+
+    std::vector<glong> articles, common;
+    find_articles(pieces[0], idxs);
+    for (size_t i = 1; i < pieces.size() && !idxs.empty(); ++i) {
+        find_articles(pieces[i], articles);
+        common.clear();
+        std::set_intersection(idxs.begin(), idxs.end(), articles.begin(), articles.end(), std::back_inserter(common));
+        idxs.swap(common);
+    }
+    return true;
+}
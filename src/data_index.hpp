@@ -0,0 +1,58 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glib.h>
+
+#include "cache_file.hpp"
+
+//inverted index of text of articles: every distinct token with indexes of
+//articles which contain it, indexes are delta encoded as variable length integers.
+//Tokens are parts of text between ASCII characters which are not letters or digits.
+class DataIndex
+{
+public:
+    //adds tokens of text to article idx
+    class Builder
+    {
+    public:
+        void add(glong idx, const gchar *text, size_t len);
+
+    private:
+        friend class DataIndex;
+        std::unordered_map<std::string, std::vector<guint32>> postings_;
+    };
+
+    DataIndex() {}
+    DataIndex(const DataIndex &) = delete;
+    DataIndex &operator=(const DataIndex &) = delete;
+
+    //load from cache of url, which is valid while url and sources are not changed,
+    //or build with fill and save to cache
+    bool load(const std::string &url, const std::list<std::string> &sources, glong wordcount,
+              const std::function<void(Builder &)> &fill);
+    //find indexes of articles which could contain all words as substrings,
+    //they are in ascending order, there could be false positives.
+    //Returns false if words consist only of token separators
+    bool lookup(const std::vector<std::string> &words, std::vector<glong> &idxs) const;
+
+    static bool is_separator(gchar ch) { return static_cast<guchar>(ch) < 0x80 && !g_ascii_isalnum(ch); }
+
+private:
+    CacheFile cache_;
+    std::vector<gchar> buffer_;
+    guint32 nwords_ = 0;
+    guint32 ntokens_ = 0;
+    const gchar *token_offsets_ = nullptr;
+    const gchar *posting_offsets_ = nullptr;
+    const guint8 *postings_ = nullptr;
+    const gchar *tokens_ = nullptr;
+
+    bool attach(const gchar *data, size_t size, glong wordcount);
+    static void build(glong wordcount, const std::function<void(Builder &)> &fill, std::vector<gchar> &buf);
+    void find_articles(const std::string &piece, std::vector<glong> &idxs) const;
+};
@@ -0,0 +1,245 @@
+/*
+ * This file part of sdcv - console version of Stardict program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstring>
+
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+
+#include "cache_file.hpp"
+#include "utils.hpp"
+
+#include "dict_catalog.hpp"
+
+namespace
+{
+const char CATALOG_MAGIC[] = "sdcv dictionary catalog, version: 2\n";
+
+// -1 if file does not exist
+gint64 get_mtime(const std::string &file_name)
+{
+    struct ::stat st;
+    if (g_stat(file_name.c_str(), &st) != 0)
+        return -1;
+    return st.st_mtime;
+}
+
+class CatalogWriter
+{
+public:
+    explicit CatalogWriter(FILE *out)
+        : out_(out)
+    {
+    }
+    bool ok() const { return ok_; }
+    void put(gint64 val) { ok_ = ok_ && fwrite(&val, sizeof(val), 1, out_) == 1; }
+    void put(const std::string &str)
+    {
+        put(gint64(str.size()));
+        ok_ = ok_ && fwrite(str.data(), 1, str.size(), out_) == str.size();
+    }
+
+private:
+    FILE *out_;
+    bool ok_ = true;
+};
+
+class CatalogReader
+{
+public:
+    CatalogReader(const gchar *begin, size_t size)
+        : p_(begin)
+        , end_(begin + size)
+    {
+    }
+    bool ok() const { return ok_; }
+    bool at_end() const { return p_ == end_; }
+    gint64 get_int()
+    {
+        gint64 val = 0;
+        if (size_t(end_ - p_) < sizeof(val)) {
+            ok_ = false;
+            return 0;
+        }
+        memcpy(&val, p_, sizeof(val));
+        p_ += sizeof(val);
+        return val;
+    }
+    std::string get_str()
+    {
+        const gint64 len = get_int();
+        if (!ok_ || len < 0 || len > end_ - p_) {
+            ok_ = false;
+            return std::string();
+        }
+        std::string res(p_, len);
+        p_ += len;
+        return res;
+    }
+
+private:
+    const gchar *p_;
+    const gchar *end_;
+    bool ok_ = true;
+};
+} // namespace
+
+DictCatalog::DictCatalog(const std::list<std::string> &dicts_dirs)
+    : dicts_dirs_(dicts_dirs)
+{
+    std::string key;
+    for (const std::string &dir : dicts_dirs_)
+        key += dir + '\n';
+    glib::CharStr checksum(g_compute_checksum_for_string(G_CHECKSUM_MD5, key.c_str(), key.size()));
+    file_name_ = std::string(g_get_user_cache_dir()) + G_DIR_SEPARATOR_S "sdcv" G_DIR_SEPARATOR_S "dicts_" + get_impl(checksum);
+}
+
+void DictCatalog::load(ThreadPool *pool, std::vector<DictInfo> &dict_infos)
+{
+    if (read(dict_infos))
+        return;
+    dict_infos.clear();
+
+    std::vector<FileTime> dirs;
+    std::vector<std::string> urls;
+    for_each_file(dicts_dirs_, ".ifo", std::list<std::string>(), std::list<std::string>(),
+                  [&urls](const std::string &url, bool) { urls.push_back(url); },
+                  [&dirs](const std::string &dir) { dirs.push_back(FileTime{ dir, get_mtime(dir) }); });
+
+    std::vector<DictInfo> infos(urls.size());
+    std::vector<gint64> mtimes(urls.size());
+    std::vector<char> loaded(urls.size(), 0);
+    auto load_info = [&urls, &infos, &mtimes, &loaded](size_t i) {
+        mtimes[i] = get_mtime(urls[i]);
+        loaded[i] = infos[i].load_from_ifo_file(urls[i], false);
+    };
+    if (pool) {
+        pool->parallel_for(urls.size(), load_info);
+    } else {
+        for (size_t i = 0; i < urls.size(); ++i)
+            load_info(i);
+    }
+    // unreadable .ifo files are checked too, so a fixed one is read again
+    std::vector<FileTime> ifos, bad_ifos;
+    for (size_t i = 0; i < urls.size(); ++i)
+        if (loaded[i]) {
+            ifos.push_back(FileTime{ urls[i], mtimes[i] });
+            dict_infos.push_back(std::move(infos[i]));
+        } else {
+            bad_ifos.push_back(FileTime{ urls[i], mtimes[i] });
+        }
+
+    write(dirs, bad_ifos, ifos, dict_infos);
+}
+
+bool DictCatalog::read(std::vector<DictInfo> &dict_infos)
+{
+    struct ::stat st;
+    if (g_stat(file_name_.c_str(), &st) != 0 || st.st_size < static_cast<off_t>(sizeof(CATALOG_MAGIC) - 1))
+        return false;
+    MapFile catalog;
+    if (!catalog.open(file_name_.c_str(), st.st_size))
+        return false;
+    if (memcmp(catalog.begin(), CATALOG_MAGIC, sizeof(CATALOG_MAGIC) - 1) != 0)
+        return false;
+    CatalogReader in(catalog.begin() + sizeof(CATALOG_MAGIC) - 1, st.st_size - (sizeof(CATALOG_MAGIC) - 1));
+
+    // files modified in the same second as catalog could be changed after it was written
+    auto is_actual = [&st](const std::string &name, gint64 mtime) {
+        return get_mtime(name) == mtime && mtime < st.st_mtime;
+    };
+
+    const gint64 ndicts_dirs = in.get_int();
+    if (!in.ok() || ndicts_dirs != gint64(dicts_dirs_.size()))
+        return false;
+    for (const std::string &dir : dicts_dirs_)
+        if (in.get_str() != dir)
+            return false;
+    for (gint64 ndirs = in.get_int(); in.ok() && ndirs > 0; --ndirs) {
+        const std::string name = in.get_str();
+        if (!in.ok() || !is_actual(name, in.get_int()))
+            return false;
+    }
+    for (gint64 nbad = in.get_int(); in.ok() && nbad > 0; --nbad) {
+        const std::string name = in.get_str();
+        if (!in.ok() || !is_actual(name, in.get_int()))
+            return false;
+    }
+    for (gint64 ndicts = in.get_int(); in.ok() && ndicts > 0; --ndicts) {
+        DictInfo info;
+        info.ifo_file_name = in.get_str();
+        if (!in.ok() || !is_actual(info.ifo_file_name, in.get_int()))
+            return false;
+        info.wordcount = in.get_int();
+        info.syn_wordcount = in.get_int();
+        info.bookname = in.get_str();
+        info.author = in.get_str();
+        info.email = in.get_str();
+        info.website = in.get_str();
+        info.date = in.get_str();
+        info.description = in.get_str();
+        info.index_file_size = in.get_int();
+        info.syn_file_size = in.get_int();
+        info.sametypesequence = in.get_str();
+        dict_infos.push_back(std::move(info));
+    }
+    return in.ok() && in.at_end();
+}
+
+void DictCatalog::write(const std::vector<FileTime> &dirs, const std::vector<FileTime> &bad_ifos,
+                        const std::vector<FileTime> &ifos, const std::vector<DictInfo> &dict_infos)
+{
+    CacheFile::save(file_name_, "", CATALOG_MAGIC, [this, &dirs, &bad_ifos, &ifos, &dict_infos](FILE *f) {
+        CatalogWriter out(f);
+        out.put(gint64(dicts_dirs_.size()));
+        for (const std::string &dir : dicts_dirs_)
+            out.put(dir);
+        out.put(gint64(dirs.size()));
+        for (const FileTime &dir : dirs) {
+            out.put(dir.name);
+            out.put(dir.mtime);
+        }
+        out.put(gint64(bad_ifos.size()));
+        for (const FileTime &ifo : bad_ifos) {
+            out.put(ifo.name);
+            out.put(ifo.mtime);
+        }
+        out.put(gint64(dict_infos.size()));
+        for (size_t i = 0; i < dict_infos.size(); ++i) {
+            const DictInfo &info = dict_infos[i];
+            out.put(ifos[i].name);
+            out.put(ifos[i].mtime);
+            out.put(gint64(info.wordcount));
+            out.put(gint64(info.syn_wordcount));
+            out.put(info.bookname);
+            out.put(info.author);
+            out.put(info.email);
+            out.put(info.website);
+            out.put(info.date);
+            out.put(info.description);
+            out.put(gint64(info.index_file_size));
+            out.put(gint64(info.syn_file_size));
+            out.put(info.sametypesequence);
+        }
+        return out.ok();
+    });
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include "stardict_lib.hpp"
+
+//infos from .ifo files of all dictionaries in some directories, they are
+//kept in user cache directory and are used while no directory and no .ifo
+//file is modified, so start does not walk directories and read .ifo files
+class DictCatalog
+{
+public:
+    explicit DictCatalog(const std::list<std::string> &dicts_dirs);
+    DictCatalog(const DictCatalog &) = delete;
+    DictCatalog &operator=(const DictCatalog &) = delete;
+
+    //infos in order of for_each_file, .ifo files which can not be read are
+    //skipped; if catalog is out of date, .ifo files are read with pool
+    void load(ThreadPool *pool, std::vector<DictInfo> &dict_infos);
+
+private:
+    struct FileTime {
+        std::string name;
+        gint64 mtime;
+    };
+
+    std::list<std::string> dicts_dirs_;
+    std::string file_name_;
+
+    bool read(std::vector<DictInfo> &dict_infos);
+    //bad_ifos are .ifo files which could not be read
+    void write(const std::vector<FileTime> &dirs, const std::vector<FileTime> &bad_ifos,
+               const std::vector<FileTime> &ifos, const std::vector<DictInfo> &dict_infos);
+};
@@ -29,6 +29,7 @@
 #include "config.h"
 #endif
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
@@ -39,6 +40,8 @@
 
 #include <sys/stat.h>
 
+#include "thread_pool.hpp"
+
 #include "dictziplib.hpp"
 
 #define USE_CACHE 1
@@ -271,8 +274,6 @@ bool DictData::open(const std::string &fname, int computeCRC)
     struct stat sb;
     int fd;
 
-    this->initialized = 0;
-
     if (stat(fname.c_str(), &sb) || !S_ISREG(sb.st_mode)) {
         //err_warning( __FUNCTION__,
         //   "%s is not a regular file -- ignoring\n", fname );
@@ -304,13 +305,6 @@ bool DictData::open(const std::string &fname, int computeCRC)
     this->start = mapfile.begin();
     this->end = this->start + this->size;
 
-    for (size_t j = 0; j < DICT_CACHE_SIZE; j++) {
-        cache[j].chunk = -1;
-        cache[j].stamp = -1;
-        cache[j].inBuffer = nullptr;
-        cache[j].count = 0;
-    }
-
     return true;
 }
 
@@ -321,41 +315,66 @@ void DictData::close()
     if (this->offsets)
         free(this->offsets);
 
-    if (this->initialized) {
-        if (inflateEnd(&this->zStream)) {
-            //err_internal( __FUNCTION__,
-            //       "Cannot shut down inflation engine: %s\n",
-            //     this->zStream.msg );
-        }
-    }
-
-    for (size_t i = 0; i < DICT_CACHE_SIZE; ++i) {
-        if (this->cache[i].inBuffer)
-            free(this->cache[i].inBuffer);
-    }
+    ChunkCache::instance().drop(id);
 }
 
-void DictData::read(char *buffer, unsigned long start, unsigned long size)
+std::atomic<guint64> DictData::last_id(0);
+
+ChunkCache::Chunk DictData::inflate_chunk(int i) const
 {
-    char *pt;
-    unsigned long end;
+    char inflated[IN_BUFFER_SIZE];
+    z_stream zStream;
     int count;
-    char *inBuffer;
-    char outBuffer[OUT_BUFFER_SIZE];
-    int firstChunk, lastChunk;
-    int firstOffset, lastOffset;
-    int i;
-    int found, target, lastStamp;
-    static int stamp = 0;
 
-    end = start + size;
+    if (i >= this->chunkCount)
+        return std::make_shared<const std::vector<char>>();
+
+    zStream.zalloc = nullptr;
+    zStream.zfree = nullptr;
+    zStream.opaque = nullptr;
+    zStream.next_in = 0;
+    zStream.avail_in = 0;
+    zStream.next_out = nullptr;
+    zStream.avail_out = 0;
+    if (inflateInit2(&zStream, -15) != Z_OK) {
+        //err_internal( __FUNCTION__,
+        //  "Cannot initialize inflation engine: %s\n",
+        //zStream.msg );
+        return std::make_shared<const std::vector<char>>();
+    }
 
-    //buffer = malloc( size + 1 );
+    /* zlib does not modify input, so it is read right from mmap'd area */
+    zStream.next_in = const_cast<Bytef *>(reinterpret_cast<const Bytef *>(this->start + this->offsets[i]));
+    zStream.avail_in = this->chunks[i];
+    zStream.next_out = (Bytef *)inflated;
+    zStream.avail_out = IN_BUFFER_SIZE;
+    if (inflate(&zStream, Z_PARTIAL_FLUSH) != Z_OK) {
+        //err_fatal( __FUNCTION__, "inflate: %s\n", zStream.msg );
+    }
+    if (zStream.avail_in) {
+        //err_internal( __FUNCTION__,
+        //    "inflate did not flush (%d pending, %d avail)\n",
+        //  zStream.avail_in, zStream.avail_out );
+    }
 
-    //PRINTF(DBG_UNZIP,
-    // ("dict_data_read( %p, %lu, %lu )\n",
-    //h, start, size ));
+    count = IN_BUFFER_SIZE - zStream.avail_out;
+    if (inflateEnd(&zStream) != Z_OK) {
+        //err_internal( __FUNCTION__,
+        //       "Cannot shut down inflation engine: %s\n",
+        //     zStream.msg );
+    }
+    /* cache keeps only inflated bytes */
+    return std::make_shared<const std::vector<char>>(inflated, inflated + count);
+}
+
+void DictData::read(char *buffer, unsigned long start, unsigned long size)
+{
+    const Range range = { start, size, buffer };
+    read(&range, &range + 1);
+}
 
+void DictData::read(const Range *begin, const Range *end)
+{
     switch (this->type) {
     case DICT_GZIP:
         //err_fatal( __FUNCTION__,
@@ -364,114 +383,71 @@ void DictData::read(char *buffer, unsigned long start, unsigned long size)
         // " or dzip format (for space savings).\n" );
         break;
     case DICT_TEXT:
-        memcpy(buffer, this->start + start, size);
-        //buffer[size] = '\0';
+        for (const Range *range = begin; range != end; ++range)
+            memcpy(range->buffer, this->start + range->start, range->size);
         break;
-    case DICT_DZIP:
-        if (!this->initialized) {
-            ++this->initialized;
-            this->zStream.zalloc = nullptr;
-            this->zStream.zfree = nullptr;
-            this->zStream.opaque = nullptr;
-            this->zStream.next_in = 0;
-            this->zStream.avail_in = 0;
-            this->zStream.next_out = nullptr;
-            this->zStream.avail_out = 0;
-            if (inflateInit2(&this->zStream, -15) != Z_OK) {
-                //err_internal( __FUNCTION__,
-                //  "Cannot initialize inflation engine: %s\n",
-                //this->zStream.msg );
-            }
+    case DICT_DZIP: {
+        /* every chunk needed by ranges, it is taken from cache or inflated once */
+        std::vector<int> needed;
+        for (const Range *range = begin; range != end; ++range) {
+            if (range->size == 0)
+                continue;
+            const int firstChunk = range->start / this->chunkLength;
+            const int lastChunk = (range->start + range->size - 1) / this->chunkLength;
+            for (int i = firstChunk; i <= lastChunk; ++i)
+                needed.push_back(i);
         }
-        firstChunk = start / this->chunkLength;
-        firstOffset = start - firstChunk * this->chunkLength;
-        lastChunk = end / this->chunkLength;
-        lastOffset = end - lastChunk * this->chunkLength;
-        //PRINTF(DBG_UNZIP,
-        // ("   start = %lu, end = %lu\n"
-        //"firstChunk = %d, firstOffset = %d,"
-        //" lastChunk = %d, lastOffset = %d\n",
-        //start, end, firstChunk, firstOffset, lastChunk, lastOffset ));
-        for (pt = buffer, i = firstChunk; i <= lastChunk; i++) {
-
-            /* Access cache */
-            found = 0;
-            target = 0;
-            lastStamp = INT_MAX;
-            for (size_t j = 0; j < DICT_CACHE_SIZE; j++) {
+        std::sort(needed.begin(), needed.end());
+        needed.erase(std::unique(needed.begin(), needed.end()), needed.end());
+
+        ChunkCache &cache = ChunkCache::instance();
+        std::vector<ChunkCache::Chunk> data(needed.size());
+        std::vector<size_t> missing;
+        for (size_t k = 0; k < needed.size(); ++k) {
 #if USE_CACHE
-                if (this->cache[j].chunk == i) {
-                    found = 1;
-                    target = j;
-                    break;
-                }
+            data[k] = cache.get(this->id, needed[k]);
 #endif
-                if (this->cache[j].stamp < lastStamp) {
-                    lastStamp = this->cache[j].stamp;
-                    target = j;
-                }
-            }
-
-            this->cache[target].stamp = ++stamp;
-            if (found) {
-                count = this->cache[target].count;
-                inBuffer = this->cache[target].inBuffer;
-            } else {
-                this->cache[target].chunk = i;
-                if (!this->cache[target].inBuffer)
-                    this->cache[target].inBuffer = (char *)malloc(IN_BUFFER_SIZE);
-                inBuffer = this->cache[target].inBuffer;
-
-                if (this->chunks[i] >= OUT_BUFFER_SIZE) {
-                    //err_internal( __FUNCTION__,
-                    //    "this->chunks[%d] = %d >= %ld (OUT_BUFFER_SIZE)\n",
-                    //  i, this->chunks[i], OUT_BUFFER_SIZE );
-                }
-                memcpy(outBuffer, this->start + this->offsets[i], this->chunks[i]);
-
-                this->zStream.next_in = (Bytef *)outBuffer;
-                this->zStream.avail_in = this->chunks[i];
-                this->zStream.next_out = (Bytef *)inBuffer;
-                this->zStream.avail_out = IN_BUFFER_SIZE;
-                if (inflate(&this->zStream, Z_PARTIAL_FLUSH) != Z_OK) {
-                    //err_fatal( __FUNCTION__, "inflate: %s\n", this->zStream.msg );
-                }
-                if (this->zStream.avail_in) {
+            if (!data[k])
+                missing.push_back(k);
+        }
+        /* chunks are independent, so they are inflated at once */
+        auto inflate_missing = [this, &cache, &needed, &data, &missing](size_t j) {
+            const size_t k = missing[j];
+            data[k] = inflate_chunk(needed[k]);
+#if USE_CACHE
+            cache.put(this->id, needed[k], data[k]);
+#endif
+        };
+        if (this->pool && missing.size() > 1)
+            this->pool->parallel_for(missing.size(), inflate_missing);
+        else
+            for (size_t j = 0; j < missing.size(); ++j)
+                inflate_missing(j);
+
+        for (const Range *range = begin; range != end; ++range) {
+            char *pt = range->buffer;
+            unsigned long pos = range->start;
+            unsigned long left = range->size;
+            while (left > 0) {
+                const int i = pos / this->chunkLength;
+                const size_t k = std::lower_bound(needed.begin(), needed.end(), i) - needed.begin();
+                const unsigned long offset = pos - (unsigned long)i * this->chunkLength;
+                const std::vector<char> &chunk = *data[k];
+                if (offset >= chunk.size()) {
                     //err_internal( __FUNCTION__,
-                    //    "inflate did not flush (%d pending, %d avail)\n",
-                    //  this->zStream.avail_in, this->zStream.avail_out );
-                }
-
-                count = IN_BUFFER_SIZE - this->zStream.avail_out;
-
-                this->cache[target].count = count;
-            }
-
-            if (i == firstChunk) {
-                if (i == lastChunk) {
-                    memcpy(pt, inBuffer + firstOffset, lastOffset - firstOffset);
-                    pt += lastOffset - firstOffset;
-                } else {
-                    if (count != this->chunkLength) {
-                        //err_internal( __FUNCTION__,
-                        //	"Length = %d instead of %d\n",
-                        //count, this->chunkLength );
-                    }
-                    memcpy(pt, inBuffer + firstOffset,
-                           this->chunkLength - firstOffset);
-                    pt += this->chunkLength - firstOffset;
+                    //	"Length = %d instead of %d\n",
+                    //count, this->chunkLength );
+                    break;
                 }
-            } else if (i == lastChunk) {
-                memcpy(pt, inBuffer, lastOffset);
-                pt += lastOffset;
-            } else {
-                assert(count == this->chunkLength);
-                memcpy(pt, inBuffer, this->chunkLength);
-                pt += this->chunkLength;
+                const unsigned long n = std::min(left, (unsigned long)chunk.size() - offset);
+                memcpy(pt, chunk.data() + offset, n);
+                pt += n;
+                pos += n;
+                left -= n;
             }
         }
-        //*pt = '\0';
         break;
+    }
     case DICT_UNKNOWN:
         //err_fatal( __FUNCTION__, "Cannot read unknown file type\n" );
         break;
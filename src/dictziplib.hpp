@@ -1,28 +1,37 @@
 #pragma once
 
+#include <atomic>
 #include <ctime>
 #include <string>
 #include <zlib.h>
 
+#include "chunk_cache.hpp"
 #include "mapfile.hpp"
 
-struct DictCache {
-    int chunk;
-    char *inBuffer;
-    int stamp;
-    int count;
-};
+class ThreadPool;
 
 class DictData
 {
 public:
-    static const size_t DICT_CACHE_SIZE = 5;
+    struct Range {
+        unsigned long start;
+        unsigned long size;
+        char *buffer;
+    };
 
-    DictData() {}
+    DictData()
+        : id(++last_id)
+    {
+    }
     ~DictData() { close(); }
     bool open(const std::string &filename, int computeCRC);
     void close();
+    // can be called from several threads at once
     void read(char *buffer, unsigned long start, unsigned long size);
+    // read ranges sorted by start, every chunk is inflated at most once
+    void read(const Range *begin, const Range *end);
+    // chunks which are not in cache are inflated with pool
+    void set_thread_pool(ThreadPool *thread_pool) { pool = thread_pool; }
 
 private:
     const char *start; /* start of mmap'd area */
@@ -30,8 +39,6 @@ private:
     off_t size; /* size of mmap */
 
     int type;
-    z_stream zStream;
-    int initialized;
 
     int headerLength;
     int method;
@@ -42,15 +49,19 @@ private:
     int version;
     int chunkLength;
     int chunkCount;
-    int *chunks;
-    unsigned long *offsets; /* Sum-scan of chunks. */
+    int *chunks = nullptr;
+    unsigned long *offsets = nullptr; /* Sum-scan of chunks. */
     std::string origFilename;
     std::string comment;
     unsigned long crc;
     off_t length;
     unsigned long compressedLength;
-    DictCache cache[DICT_CACHE_SIZE];
+    /* inflated chunks are kept in ChunkCache with this id */
+    const guint64 id;
+    static std::atomic<guint64> last_id;
+    ThreadPool *pool = nullptr;
     MapFile mapfile;
 
     int read_header(const std::string &filename, int computeCRC);
+    ChunkCache::Chunk inflate_chunk(int i) const;
 };
@@ -33,6 +33,7 @@ The Levenshtein distance algorithm has been used in:
     * Plagiarism detection 
 */
 
+#include <cassert>
 #include <cstdlib>
 #include <cstring>
 
@@ -47,6 +48,12 @@ Enhanced Dynamic Programming ASM Algorithm"
 */
 #define COVER_TRANSPOSITION
 
+/*
+Compare every result of the bit-parallel algorithm with the matrix one.
+It is slow, use it only to check changes of the algorithms.
+*/
+//#define VERIFY_EDIT_DISTANCE
+
 /****************************************/
 /*Implementation of Levenshtein distance*/
 /****************************************/
@@ -62,7 +69,7 @@ static inline int minimum(const int a, const int b, const int c)
     return min;
 }
 
-int EditDistance::CalEditDistance(const gunichar *s, const gunichar *t, const int limit)
+int EditDistance::CalEditDistanceMatrix(const gunichar *s, const gunichar *t, const int limit)
 /*Compute levenshtein distance between s and t, this is using QUICK algorithm*/
 {
     int n = 0, m = 0, iLenDif, k, i, j, cost;
@@ -143,3 +150,96 @@ int EditDistance::CalEditDistance(const gunichar *s, const gunichar *t, const in
     // d(n-1,m-1)
     return d[n * m - 1];
 }
+
+/***********************************************************/
+/*Bit-parallel algorithm, one bit for every character of t */
+/***********************************************************/
+/*
+Hyyrö, Heikki : "A Bit-Vector Algorithm for Computing
+Levenshtein and Damerau Edit Distances", Nordic Journal
+of Computing 10 (2003). It is Myers' algorithm with the
+transposition, so it gives the same distance as the matrix.
+*/
+
+void EditDistance::set_pattern(const gunichar *t, int m)
+{
+    if (int(pattern.size()) == m && std::equal(pattern.begin(), pattern.end(), t))
+        return;
+    pattern.assign(t, t + m);
+    for (guint64 &mask : peq_ascii)
+        mask = 0;
+    peq_other.clear();
+    for (int i = 0; i < m; i++) {
+        if (t[i] < G_N_ELEMENTS(peq_ascii)) {
+            peq_ascii[t[i]] |= guint64(1) << i;
+            continue;
+        }
+        auto it = peq_other.begin();
+        while (it != peq_other.end() && it->first != t[i])
+            ++it;
+        if (it == peq_other.end())
+            it = peq_other.insert(it, std::make_pair(t[i], guint64(0)));
+        it->second |= guint64(1) << i;
+    }
+}
+
+inline guint64 EditDistance::peq(gunichar ch) const
+{
+    if (ch < G_N_ELEMENTS(peq_ascii))
+        return peq_ascii[ch];
+    for (const auto &item : peq_other)
+        if (item.first == ch)
+            return item.second;
+    return 0;
+}
+
+int EditDistance::bit_parallel_distance(const gunichar *s, int m, const int limit) const
+{
+    int n = 0;
+    while (s[n])
+        n++;
+    if (m == 0)
+        return n;
+
+    const guint64 last = guint64(1) << (m - 1);
+    guint64 VP = ~guint64(0) >> (64 - m), VN = 0, D0 = 0, PM = 0;
+    int score = m;
+    for (int j = 0; j < n; j++) {
+        const guint64 prevD0 = D0, prevPM = PM;
+        PM = peq(s[j]);
+        D0 = (((PM & VP) + VP) ^ VP) | PM | VN;
+#ifdef COVER_TRANSPOSITION
+        D0 |= ((~prevD0 & PM) << 1) & prevPM;
+#endif
+        guint64 HP = VN | ~(D0 | VP);
+        const guint64 HN = VP & D0;
+        if (HP & last)
+            score++;
+        else if (HN & last)
+            score--;
+        // every of the rest characters can decrease distance only by one
+        if (score - (n - j - 1) >= limit)
+            return score - (n - j - 1);
+        HP = (HP << 1) | 1;
+        VP = (HN << 1) | ~(D0 | HP);
+        VN = D0 & HP;
+    }
+    return score;
+}
+
+int EditDistance::CalEditDistance(const gunichar *s, const gunichar *t, const int limit)
+{
+    int m = 0;
+    while (t[m])
+        m++;
+    if (m > 64)
+        return CalEditDistanceMatrix(s, t, limit);
+
+    set_pattern(t, m);
+    const int res = bit_parallel_distance(s, m, limit);
+#ifdef VERIFY_EDIT_DISTANCE
+    const int expected = CalEditDistanceMatrix(s, t, limit);
+    assert(res == expected || (res >= limit && expected >= limit));
+#endif
+    return res;
+}
@@ -2,6 +2,8 @@
 
 #include <cstdlib>
 #include <glib.h>
+#include <utility>
+#include <vector>
 
 class EditDistance
 {
@@ -18,9 +20,22 @@ public:
     }
     EditDistance(const EditDistance &) = delete;
     EditDistance &operator=(const EditDistance &) = delete;
+    //t is usually the same for many calls, so it is prepared once
     int CalEditDistance(const gunichar *s, const gunichar *t, const int limit);
+    //the old algorithm with matrix, it is used for long words
+    //and to verify the bit-parallel one
+    int CalEditDistanceMatrix(const gunichar *s, const gunichar *t, const int limit);
 
 private:
     int *d;
     int currentelements;
+
+    //bit masks of positions of every character in pattern
+    std::vector<gunichar> pattern;
+    guint64 peq_ascii[128];
+    std::vector<std::pair<gunichar, guint64>> peq_other;
+
+    void set_pattern(const gunichar *t, int m);
+    guint64 peq(gunichar ch) const;
+    int bit_parallel_distance(const gunichar *s, int m, const int limit) const;
 };
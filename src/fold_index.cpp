@@ -0,0 +1,177 @@
+/*
+ * This file part of sdcv - console version of Stardict program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "stardict_lib.hpp"
+#include "utils.hpp"
+
+#include "fold_index.hpp"
+
+namespace
+{
+const char FOLD_INDEX_MAGIC[] = "sdcv fold index, version: 1\n";
+// header: number of distinct keys, wordcount, syn_wordcount, size of keys
+const size_t HEADER_SIZE = 4 * sizeof(guint32);
+
+void append_uint32(std::vector<gchar> &buf, guint32 val)
+{
+    const size_t pos = buf.size();
+    buf.resize(pos + sizeof(guint32));
+    set_uint32(&buf[pos], val);
+}
+} // namespace
+
+std::string FoldIndex::fold_case(const gchar *str)
+{
+    glib::CharStr folded(g_utf8_casefold(str, -1));
+    return get_impl(folded);
+}
+
+std::string FoldIndex::fold_marks(const gchar *str)
+{
+    // marks are separate characters after decomposition
+    glib::CharStr decomposed(g_utf8_normalize(str, -1, G_NORMALIZE_NFKD));
+    if (decomposed == nullptr)
+        return fold_case(str);
+    std::string letters;
+    for (const gchar *p = get_impl(decomposed); *p; p = g_utf8_next_char(p))
+        if (!g_unichar_ismark(g_utf8_get_char(p)))
+            letters.append(p, g_utf8_next_char(p) - p);
+    glib::CharStr folded(g_utf8_casefold(letters.c_str(), -1));
+    glib::CharStr composed(g_utf8_normalize(get_impl(folded), -1, G_NORMALIZE_NFKC));
+    return composed != nullptr ? get_impl(composed) : get_impl(folded);
+}
+
+bool FoldIndex::load(const std::string &url, const std::string &suffix, const std::list<std::string> &sources,
+                     const Fold &fold, glong wordcount, const std::function<const gchar *(glong)> &get_key,
+                     glong syn_wordcount, const std::function<const gchar *(glong)> &get_syn_key)
+{
+    const std::string magic(FOLD_INDEX_MAGIC);
+    if (cache_.load(url, suffix, magic, sources) && attach(cache_.data(), cache_.size(), wordcount, syn_wordcount))
+        return true;
+
+    build(fold, wordcount, get_key, syn_wordcount, get_syn_key, buffer_);
+    CacheFile::save(url, suffix, magic, [this](FILE *out) {
+        return fwrite(&buffer_[0], 1, buffer_.size(), out) == buffer_.size();
+    });
+    return attach(&buffer_[0], buffer_.size(), wordcount, syn_wordcount);
+}
+
+void FoldIndex::build(const Fold &fold, glong wordcount, const std::function<const gchar *(glong)> &get_key,
+                      glong syn_wordcount, const std::function<const gchar *(glong)> &get_syn_key,
+                      std::vector<gchar> &buf)
+{
+    const glong nplaces = wordcount + syn_wordcount;
+    std::vector<std::pair<std::string, guint32>> words(nplaces);
+    for (glong i = 0; i < nplaces; ++i) {
+        words[i].first = fold(i < wordcount ? get_key(i) : get_syn_key(i - wordcount));
+        words[i].second = i;
+    }
+    std::sort(words.begin(), words.end());
+
+    std::vector<guint32> key_offsets, place_offsets;
+    std::string keys;
+    for (glong i = 0; i < nplaces; ++i) {
+        if (i == 0 || words[i].first != words[i - 1].first) {
+            key_offsets.push_back(keys.size());
+            place_offsets.push_back(i);
+            keys.append(words[i].first.c_str(), words[i].first.size() + 1);
+        }
+    }
+    key_offsets.push_back(keys.size());
+    place_offsets.push_back(nplaces);
+
+    buf.clear();
+    append_uint32(buf, key_offsets.size() - 1);
+    append_uint32(buf, wordcount);
+    append_uint32(buf, syn_wordcount);
+    append_uint32(buf, keys.size());
+    for (guint32 off : key_offsets)
+        append_uint32(buf, off);
+    for (guint32 off : place_offsets)
+        append_uint32(buf, off);
+    for (const auto &word : words)
+        append_uint32(buf, word.second);
+    buf.insert(buf.end(), keys.begin(), keys.end());
+}
+
+bool FoldIndex::attach(const gchar *data, size_t size, glong wordcount, glong syn_wordcount)
+{
+    if (size < HEADER_SIZE)
+        return false;
+    const guint32 nkeys = get_uint32(data);
+    const guint64 nplaces = guint64(wordcount) + syn_wordcount;
+    const guint32 keys_size = get_uint32(data + 3 * sizeof(guint32));
+    if (get_uint32(data + sizeof(guint32)) != guint32(wordcount)
+        || get_uint32(data + 2 * sizeof(guint32)) != guint32(syn_wordcount)
+        || size != HEADER_SIZE + (2 * (guint64(nkeys) + 1) + nplaces) * sizeof(guint32) + keys_size)
+        return false;
+
+    // a bad cache should not give keys and places out of range
+    const gchar *key_offsets = data + HEADER_SIZE;
+    const gchar *place_offsets = key_offsets + (nkeys + 1) * sizeof(guint32);
+    const gchar *places = place_offsets + (nkeys + 1) * sizeof(guint32);
+    const gchar *keys = places + nplaces * sizeof(guint32);
+    if (get_uint32(key_offsets + nkeys * sizeof(guint32)) != keys_size
+        || get_uint32(place_offsets + nkeys * sizeof(guint32)) != nplaces
+        || (keys_size > 0 && keys[keys_size - 1] != '\0'))
+        return false;
+    for (guint32 i = 0; i < nkeys; ++i)
+        if (get_uint32(key_offsets + i * sizeof(guint32)) >= keys_size
+            || get_uint32(place_offsets + i * sizeof(guint32)) > get_uint32(place_offsets + (i + 1) * sizeof(guint32)))
+            return false;
+    for (guint64 i = 0; i < nplaces; ++i)
+        if (get_uint32(places + i * sizeof(guint32)) >= nplaces)
+            return false;
+
+    nkeys_ = nkeys;
+    key_offsets_ = key_offsets;
+    place_offsets_ = place_offsets;
+    places_ = places;
+    keys_ = keys;
+    return true;
+}
+
+inline const gchar *FoldIndex::key(guint32 i) const
+{
+    return keys_ + get_uint32(key_offsets_ + i * sizeof(guint32));
+}
+
+void FoldIndex::lookup(const char *folded, std::vector<guint32> &places) const
+{
+    guint32 from = 0, to = nkeys_;
+    while (from < to) {
+        const guint32 middle = from + (to - from) / 2;
+        if (strcmp(key(middle), folded) < 0)
+            from = middle + 1;
+        else
+            to = middle;
+    }
+    if (from == nkeys_ || strcmp(key(from), folded) != 0)
+        return;
+    for (guint32 i = get_uint32(place_offsets_ + from * sizeof(guint32));
+         i < get_uint32(place_offsets_ + (from + 1) * sizeof(guint32)); ++i)
+        places.push_back(get_uint32(places_ + i * sizeof(guint32)));
+}
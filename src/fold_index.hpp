@@ -0,0 +1,54 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include "cache_file.hpp"
+
+//sorted list of distinct folded forms of words and synonyms of dictionary,
+//every one with places of words which give it, so words which differ only in
+//what folding removes are found with one binary search. Folding is one of
+//functions below, every one has its own cache.
+class FoldIndex
+{
+public:
+    typedef std::function<std::string(const gchar *)> Fold;
+
+    FoldIndex() {}
+    FoldIndex(const FoldIndex &) = delete;
+    FoldIndex &operator=(const FoldIndex &) = delete;
+
+    //case of letters is ignored, not only of ASCII ones
+    static std::string fold_case(const gchar *str);
+    //also diacritical marks and compatibility forms of characters (NFKD)
+    //are ignored, so "café", "cafe" and "Café" are the same
+    static std::string fold_marks(const gchar *str);
+
+    //load from cache of url with suffix or build with fold, get_key and get_syn_key
+    //and save to cache, sources are other files of dictionary which the cache depends on
+    bool load(const std::string &url, const std::string &suffix, const std::list<std::string> &sources,
+              const Fold &fold, glong wordcount, const std::function<const gchar *(glong)> &get_key,
+              glong syn_wordcount, const std::function<const gchar *(glong)> &get_syn_key);
+    //add to places words which folded form is folded: index of word,
+    //or wordcount plus index of synonym
+    void lookup(const char *folded, std::vector<guint32> &places) const;
+
+private:
+    CacheFile cache_;
+    std::vector<gchar> buffer_;
+    guint32 nkeys_ = 0;
+    const gchar *key_offsets_ = nullptr;
+    const gchar *place_offsets_ = nullptr;
+    const gchar *places_ = nullptr;
+    const gchar *keys_ = nullptr;
+
+    bool attach(const gchar *data, size_t size, glong wordcount, glong syn_wordcount);
+    static void build(const Fold &fold, glong wordcount, const std::function<const gchar *(glong)> &get_key,
+                      glong syn_wordcount, const std::function<const gchar *(glong)> &get_syn_key,
+                      std::vector<gchar> &buf);
+    const gchar *key(guint32 i) const;
+};
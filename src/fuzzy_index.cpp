@@ -0,0 +1,250 @@
+/*
+ * This file part of sdcv - console version of Stardict program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "stardict_lib.hpp"
+
+#include "fuzzy_index.hpp"
+
+namespace
+{
+const char FUZZY_INDEX_MAGIC[] = "sdcv fuzzy index, version: 1\n";
+// header: number of distinct keys, number of indexes, size of keys
+const size_t HEADER_SIZE = 3 * sizeof(guint32);
+// word length is stored in one byte
+const glong MAX_KEY_LEN = 255;
+
+void append_uint32(std::vector<gchar> &buf, guint32 val)
+{
+    const size_t pos = buf.size();
+    buf.resize(pos + sizeof(guint32));
+    set_uint32(&buf[pos], val);
+}
+} // namespace
+
+bool FuzzyIndex::load(const std::string &url, glong wordcount, const std::function<const gchar *(glong)> &get_key)
+{
+    const std::string magic(FUZZY_INDEX_MAGIC);
+    if (cache_.load(url, ".fzi", magic) && attach(cache_.data(), cache_.size(), wordcount))
+        return true;
+
+    build(wordcount, get_key, buffer_);
+    CacheFile::save(url, ".fzi", magic, [this](FILE *out) {
+        return fwrite(&buffer_[0], 1, buffer_.size(), out) == buffer_.size();
+    });
+    return attach(&buffer_[0], buffer_.size(), wordcount);
+}
+
+void FuzzyIndex::build(glong wordcount, const std::function<const gchar *(glong)> &get_key, std::vector<gchar> &buf)
+{
+    std::vector<std::pair<std::string, guint32>> words(wordcount);
+    std::vector<guint8> lens;
+    for (glong i = 0; i < wordcount; ++i) {
+        glong len;
+        gunichar *ucs4_str = g_utf8_to_ucs4_fast(get_key(i), -1, &len);
+        std::string &key = words[i].first;
+        gchar utf8[6];
+        for (glong j = 0; j < len; ++j)
+            key.append(utf8, g_unichar_to_utf8(g_unichar_tolower(ucs4_str[j]), utf8));
+        g_free(ucs4_str);
+        words[i].second = i;
+    }
+    // byte order of utf8 is the same as order of code points
+    std::sort(words.begin(), words.end());
+
+    std::vector<guint32> key_offsets, idx_offsets;
+    std::string keys;
+    for (glong i = 0; i < wordcount; ++i) {
+        if (i == 0 || words[i].first != words[i - 1].first) {
+            key_offsets.push_back(keys.size());
+            idx_offsets.push_back(i);
+            keys.append(words[i].first.c_str(), words[i].first.size() + 1);
+            lens.push_back(std::min(g_utf8_strlen(words[i].first.c_str(), -1), MAX_KEY_LEN));
+        }
+    }
+    key_offsets.push_back(keys.size());
+    idx_offsets.push_back(wordcount);
+
+    buf.clear();
+    append_uint32(buf, lens.size());
+    append_uint32(buf, wordcount);
+    append_uint32(buf, keys.size());
+    for (guint32 off : key_offsets)
+        append_uint32(buf, off);
+    for (guint32 off : idx_offsets)
+        append_uint32(buf, off);
+    for (const auto &word : words)
+        append_uint32(buf, word.second);
+    buf.insert(buf.end(), lens.begin(), lens.end());
+    buf.insert(buf.end(), keys.begin(), keys.end());
+}
+
+bool FuzzyIndex::attach(const gchar *data, size_t size, glong wordcount)
+{
+    if (size < HEADER_SIZE)
+        return false;
+    const guint32 nkeys = get_uint32(data);
+    const guint32 nidxs = get_uint32(data + sizeof(guint32));
+    const guint32 keys_size = get_uint32(data + 2 * sizeof(guint32));
+    if (nidxs != guint32(wordcount)
+        || size != HEADER_SIZE + 2 * (guint64(nkeys) + 1) * sizeof(guint32) + guint64(nidxs) * sizeof(guint32) + nkeys + keys_size)
+        return false;
+
+    const gchar *key_offsets = data + HEADER_SIZE;
+    const gchar *idx_offsets = key_offsets + (guint64(nkeys) + 1) * sizeof(guint32);
+    const gchar *idxs = idx_offsets + (guint64(nkeys) + 1) * sizeof(guint32);
+    const guint8 *key_lens = reinterpret_cast<const guint8 *>(idxs + guint64(nidxs) * sizeof(guint32));
+    const gchar *keys = reinterpret_cast<const gchar *>(key_lens + nkeys);
+    if (get_uint32(key_offsets) != 0 || get_uint32(key_offsets + nkeys * sizeof(guint32)) != keys_size
+        || get_uint32(idx_offsets) != 0 || get_uint32(idx_offsets + nkeys * sizeof(guint32)) != nidxs)
+        return false;
+    // lookup walks over characters of keys, so every key should be valid utf8
+    // which ends with '\0' and has its length, and every key has some indexes
+    for (guint32 i = 0; i < nkeys; ++i) {
+        const guint32 key_begin = get_uint32(key_offsets + i * sizeof(guint32));
+        const guint32 key_end = get_uint32(key_offsets + (i + 1) * sizeof(guint32));
+        if (key_end <= key_begin || key_end > keys_size || keys[key_end - 1] != '\0'
+            || !g_utf8_validate(keys + key_begin, key_end - key_begin - 1, nullptr)
+            || key_lens[i] != std::min(g_utf8_strlen(keys + key_begin, key_end - key_begin - 1), MAX_KEY_LEN)
+            || get_uint32(idx_offsets + i * sizeof(guint32)) >= get_uint32(idx_offsets + (i + 1) * sizeof(guint32)))
+            return false;
+    }
+
+    nkeys_ = nkeys;
+    nidxs_ = nidxs;
+    key_offsets_ = key_offsets;
+    idx_offsets_ = idx_offsets;
+    idxs_ = idxs;
+    key_lens_ = key_lens;
+    keys_ = keys;
+    return true;
+}
+
+inline const gchar *FuzzyIndex::key(guint32 i) const
+{
+    return keys_ + get_uint32(key_offsets_ + i * sizeof(guint32));
+}
+
+// first key after i which does not start with prefix_len bytes of key i
+guint32 FuzzyIndex::skip_prefix(guint32 i, size_t prefix_len) const
+{
+    const gchar *prefix = key(i);
+    guint32 from = i + 1, to = nkeys_;
+    while (from < to) {
+        const guint32 middle = from + (to - from) / 2;
+        if (strncmp(key(middle), prefix, prefix_len) == 0)
+            from = middle + 1;
+        else
+            to = middle;
+    }
+    return from;
+}
+
+bool FuzzyIndex::lookup(const gunichar *str, glong len, int max_distance, std::vector<glong> &idxs) const
+{
+    if (len + max_distance >= MAX_KEY_LEN)
+        return false;
+
+    // rows of edit distance matrix for every prefix of the current key,
+    // the transposition needs two previous rows
+    const glong width = len + 1;
+    std::vector<int> rows(width * width);
+    std::vector<int> mins(width);
+    std::vector<gunichar> prefix;
+    for (glong j = 0; j < width; ++j)
+        rows[j] = j;
+    mins[0] = 0;
+
+    std::vector<guint32> found;
+    guint32 i = 0;
+    while (i < nkeys_) {
+        const gchar *p = key(i);
+        const glong key_len = key_lens_[i];
+        const glong depth_max = std::min(key_len, len);
+
+        // rows of common prefix with the previous key are still valid
+        glong depth = 0;
+        while (depth < glong(prefix.size()) && depth < depth_max && g_utf8_get_char(p) == prefix[depth]) {
+            ++depth;
+            p = g_utf8_next_char(p);
+        }
+        prefix.resize(depth);
+
+        bool hopeless = false;
+        while (depth < depth_max) {
+            const gunichar ch = g_utf8_get_char(p);
+            p = g_utf8_next_char(p);
+            prefix.push_back(ch);
+            ++depth;
+
+            int *cur = &rows[depth * width];
+            const int *prev = cur - width;
+            cur[0] = depth;
+            int row_min = depth;
+            for (glong j = 1; j < width; ++j) {
+                int d = std::min(std::min(prev[j], cur[j - 1]) + 1, prev[j - 1] + (ch != str[j - 1]));
+                if (depth >= 2 && j >= 2 && ch == str[j - 2] && prefix[depth - 2] == str[j - 1])
+                    d = std::min(d, prev[j - 2 - width] + 1);
+                cur[j] = d;
+                row_min = std::min(row_min, d);
+            }
+            mins[depth] = row_min;
+            // no longer key can get less distance than this
+            if (std::min(mins[depth], mins[depth - 1] + 1) >= max_distance) {
+                hopeless = true;
+                break;
+            }
+        }
+
+        if (hopeless) {
+            i = skip_prefix(i, p - key(i));
+        } else if (key_len <= len) {
+            if (len - key_len < max_distance && rows[key_len * width + len] < max_distance)
+                found.push_back(i);
+            ++i;
+        } else {
+            // all keys with the same first len letters are cut to the same string
+            const guint32 end = skip_prefix(i, p - key(i));
+            if (rows[len * width + len] < max_distance)
+                for (; i < end; ++i)
+                    if (key_lens_[i] - len < max_distance)
+                        found.push_back(i);
+            i = end;
+        }
+    }
+
+    for (guint32 k : found) {
+        const guint32 from = get_uint32(idx_offsets_ + k * sizeof(guint32));
+        const guint32 to = get_uint32(idx_offsets_ + (k + 1) * sizeof(guint32));
+        for (guint32 j = from; j < to; ++j) {
+            const guint32 idx = get_uint32(idxs_ + j * sizeof(guint32));
+            // cache is broken, but only existing words are given
+            if (idx < nidxs_)
+                idxs.push_back(idx);
+        }
+    }
+    std::sort(idxs.begin(), idxs.end());
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include "cache_file.hpp"
+
+//sorted list of distinct lower case words of dictionary, every one with
+//indexes of words which give it. Fuzzy search walks over it like over trie:
+//edit distance is calculated once for common prefix of neighbour words,
+//and all words with hopeless prefix are skipped with binary search.
+class FuzzyIndex
+{
+public:
+    FuzzyIndex() {}
+    FuzzyIndex(const FuzzyIndex &) = delete;
+    FuzzyIndex &operator=(const FuzzyIndex &) = delete;
+
+    //load from cache of url or build with get_key and save to cache
+    bool load(const std::string &url, glong wordcount, const std::function<const gchar *(glong)> &get_key);
+    //find indexes of all words which lower case form, cut to the length of str,
+    //has edit distance less than max_distance to str, and which length differs
+    //from the length of str less than max_distance; str should be in lower case.
+    //Indexes are in ascending order, there could be false positives.
+    //Returns false if there are too long words to answer.
+    bool lookup(const gunichar *str, glong len, int max_distance, std::vector<glong> &idxs) const;
+
+private:
+    CacheFile cache_;
+    std::vector<gchar> buffer_;
+    guint32 nkeys_ = 0;
+    guint32 nidxs_ = 0;
+    const gchar *key_offsets_ = nullptr;
+    const gchar *idx_offsets_ = nullptr;
+    const gchar *idxs_ = nullptr;
+    const guint8 *key_lens_ = nullptr;
+    const gchar *keys_ = nullptr;
+
+    bool attach(const gchar *data, size_t size, glong wordcount);
+    static void build(glong wordcount, const std::function<const gchar *(glong)> &get_key, std::vector<gchar> &buf);
+    const gchar *key(guint32 i) const;
+    guint32 skip_prefix(guint32 i, size_t prefix_len) const;
+};
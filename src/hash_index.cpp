@@ -0,0 +1,206 @@
+/*
+ * This file part of sdcv - console version of Stardict program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+#include "stardict_lib.hpp"
+
+#include "hash_index.hpp"
+
+namespace
+{
+const char HASH_INDEX_MAGIC[] = "sdcv hash index, version: 1\n";
+// header: number of words, number of buckets, wordcount, syn_wordcount
+const size_t HEADER_SIZE = 4;
+const size_t ENTRY_SIZE = sizeof(HashIndex::Entry) / sizeof(guint32);
+// seed of bucket with one word is its place
+const guint32 DIRECT_SLOT = 0x80000000;
+// buckets with more words try so many seeds before build gives up
+const guint32 MAX_SEED = 1 << 24;
+
+// FNV-1a of string with ASCII letters in lower case
+guint64 hash_word(const char *str)
+{
+    guint64 hash = 14695981039346656037ULL;
+    for (const guchar *p = reinterpret_cast<const guchar *>(str); *p; ++p) {
+        hash ^= guchar(g_ascii_tolower(*p));
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// finalizer of splitmix64, every bit of result depends on every bit of x
+guint64 mix(guint64 x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+guint64 seeded_hash(guint64 hash, guint32 seed)
+{
+    return mix(hash + seed * 0x9e3779b97f4a7c15ULL);
+}
+} // namespace
+
+bool HashIndex::load(const std::string &url, const std::list<std::string> &sources,
+                     glong wordcount, const std::function<const gchar *(glong)> &get_key,
+                     glong syn_wordcount, const std::function<const gchar *(glong)> &get_syn_key)
+{
+    const std::string magic(HASH_INDEX_MAGIC);
+    if (cache_.load(url, ".mph", magic, sources) && attach(cache_.data(), cache_.size(), wordcount, syn_wordcount))
+        return true;
+
+    if (!build(wordcount, get_key, syn_wordcount, get_syn_key, buffer_))
+        return false;
+    CacheFile::save(url, ".mph", magic, [this](FILE *out) {
+        return fwrite(&buffer_[0], sizeof(buffer_[0]), buffer_.size(), out) == buffer_.size();
+    });
+    return attach(reinterpret_cast<const gchar *>(&buffer_[0]), buffer_.size() * sizeof(buffer_[0]), wordcount, syn_wordcount);
+}
+
+bool HashIndex::build(glong wordcount, const std::function<const gchar *(glong)> &get_key,
+                      glong syn_wordcount, const std::function<const gchar *(glong)> &get_syn_key,
+                      std::vector<guint32> &buf)
+{
+    std::vector<std::pair<std::string, Entry>> ranges;
+    if (!collect_word_ranges(wordcount, get_key, syn_wordcount, get_syn_key, ranges))
+        return false;
+
+    const guint32 nkeys = ranges.size();
+    const guint32 nbuckets = nkeys / 2 + 1;
+    std::vector<std::pair<guint64, Entry>> keys;
+    keys.reserve(nkeys);
+    for (const auto &range : ranges)
+        keys.emplace_back(hash_word(range.first.c_str()), range.second);
+    ranges.clear();
+
+    std::vector<std::vector<guint32>> buckets(nbuckets);
+    for (guint32 i = 0; i < nkeys; ++i)
+        buckets[mix(keys[i].first) % nbuckets].push_back(i);
+    std::vector<guint32> order(nbuckets);
+    for (guint32 b = 0; b < nbuckets; ++b)
+        order[b] = b;
+    // big buckets are placed first, while there are many free places
+    std::stable_sort(order.begin(), order.end(), [&buckets](guint32 lh, guint32 rh) {
+        return buckets[lh].size() > buckets[rh].size();
+    });
+
+    buf.assign(HEADER_SIZE + nbuckets + nkeys * ENTRY_SIZE, 0);
+    buf[0] = nkeys;
+    buf[1] = nbuckets;
+    buf[2] = wordcount;
+    buf[3] = syn_wordcount;
+    guint32 *seeds = &buf[HEADER_SIZE];
+    guint32 *entries = seeds + nbuckets;
+    std::vector<bool> taken(nkeys);
+    std::vector<guint32> slots;
+    guint32 next_free = 0;
+    for (guint32 b : order) {
+        const std::vector<guint32> &bucket = buckets[b];
+        if (bucket.empty())
+            break;
+        if (bucket.size() == 1) {
+            while (taken[next_free])
+                ++next_free;
+            seeds[b] = DIRECT_SLOT | next_free;
+            slots.assign(1, next_free);
+        } else {
+            guint32 seed = 1;
+            for (; seed < MAX_SEED; ++seed) {
+                slots.clear();
+                for (guint32 i : bucket) {
+                    const guint32 slot = seeded_hash(keys[i].first, seed) % nkeys;
+                    if (taken[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end())
+                        break;
+                    slots.push_back(slot);
+                }
+                if (slots.size() == bucket.size())
+                    break;
+            }
+            // words with the same hash can not be separated
+            if (seed == MAX_SEED)
+                return false;
+            seeds[b] = seed;
+        }
+        for (size_t i = 0; i < bucket.size(); ++i) {
+            taken[slots[i]] = true;
+            memcpy(entries + slots[i] * ENTRY_SIZE, &keys[bucket[i]].second, sizeof(Entry));
+        }
+    }
+    return true;
+}
+
+bool HashIndex::attach(const gchar *data, size_t size, glong wordcount, glong syn_wordcount)
+{
+    if (size < HEADER_SIZE * sizeof(guint32))
+        return false;
+    const guint32 nkeys = get_uint32(data);
+    const guint32 nbuckets = get_uint32(data + sizeof(guint32));
+    if (get_uint32(data + 2 * sizeof(guint32)) != guint32(wordcount)
+        || get_uint32(data + 3 * sizeof(guint32)) != guint32(syn_wordcount)
+        || size != (HEADER_SIZE + guint64(nbuckets) + guint64(nkeys) * ENTRY_SIZE) * sizeof(guint32)
+        || (nkeys > 0 && nbuckets == 0))
+        return false;
+
+    // a bad cache should not give places out of range
+    const gchar *seeds = data + HEADER_SIZE * sizeof(guint32);
+    const gchar *entries = seeds + nbuckets * sizeof(guint32);
+    for (guint32 b = 0; b < nbuckets; ++b) {
+        const guint32 seed = get_uint32(seeds + b * sizeof(guint32));
+        if ((seed & DIRECT_SLOT) && (seed & ~DIRECT_SLOT) >= nkeys)
+            return false;
+    }
+    for (guint32 i = 0; i < nkeys; ++i) {
+        Entry entry;
+        memcpy(&entry, entries + i * sizeof(Entry), sizeof(Entry));
+        if (guint64(entry.idx_from) + entry.idx_count > guint64(wordcount)
+            || guint64(entry.syn_from) + entry.syn_count > guint64(syn_wordcount))
+            return false;
+    }
+
+    nkeys_ = nkeys;
+    nbuckets_ = nbuckets;
+    seeds_ = seeds;
+    entries_ = entries;
+    return true;
+}
+
+inline guint32 HashIndex::slot(guint64 hash) const
+{
+    const guint32 seed = get_uint32(seeds_ + (mix(hash) % nbuckets_) * sizeof(guint32));
+    if (seed & DIRECT_SLOT)
+        return seed & ~DIRECT_SLOT;
+    return seeded_hash(hash, seed) % nkeys_;
+}
+
+HashIndex::Entry HashIndex::lookup(const char *str) const
+{
+    Entry entry{ 0, 0, 0, 0 };
+    if (nkeys_ > 0)
+        memcpy(&entry, entries_ + slot(hash_word(str)) * sizeof(Entry), sizeof(Entry));
+    return entry;
+}
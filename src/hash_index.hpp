@@ -0,0 +1,48 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include "cache_file.hpp"
+#include "word_ranges.hpp"
+
+//minimal perfect hash of words and synonyms of dictionary with ASCII letters
+//in lower case. Such words are next to each other in index and in synonym file,
+//because both are sorted by stardict_strcmp, so every hash value gives ranges
+//of them. Any string gets some value, so found words should be compared with it.
+class HashIndex
+{
+public:
+    typedef WordRanges Entry;
+
+    HashIndex() {}
+    HashIndex(const HashIndex &) = delete;
+    HashIndex &operator=(const HashIndex &) = delete;
+
+    //load from cache of url or build with get_key and get_syn_key and save to cache,
+    //sources are other files of dictionary which the cache depends on;
+    //false if index and synonyms are not sorted
+    bool load(const std::string &url, const std::list<std::string> &sources,
+              glong wordcount, const std::function<const gchar *(glong)> &get_key,
+              glong syn_wordcount, const std::function<const gchar *(glong)> &get_syn_key);
+    //entry of words which could be equal to str ignoring case of ASCII letters
+    Entry lookup(const char *str) const;
+
+private:
+    CacheFile cache_;
+    std::vector<guint32> buffer_;
+    guint32 nkeys_ = 0;
+    guint32 nbuckets_ = 0;
+    const gchar *seeds_ = nullptr;
+    const gchar *entries_ = nullptr;
+
+    bool attach(const gchar *data, size_t size, glong wordcount, glong syn_wordcount);
+    static bool build(glong wordcount, const std::function<const gchar *(glong)> &get_key,
+                      glong syn_wordcount, const std::function<const gchar *(glong)> &get_syn_key,
+                      std::vector<guint32> &buf);
+    guint32 slot(guint64 hash) const;
+};
@@ -0,0 +1,75 @@
+/*
+ * This file part of sdcv - console version of Stardict program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "key_offsets.hpp"
+
+namespace
+{
+const char KEY_OFFSETS_MAGIC[] = "sdcv key offsets, version: 1\n";
+}
+
+bool KeyOffsets::load(const std::string &url, const gchar *data, size_t size, gulong count, size_t data_size)
+{
+    const std::string magic(KEY_OFFSETS_MAGIC);
+    if (cache_.load(url, ".oft", magic) && attach(cache_.data(), cache_.size(), data, size, count, data_size))
+        return true;
+
+    buffer_.resize(count + 1);
+    const gchar *p = data;
+    const gchar *end = data + size;
+    for (gulong i = 0; i < count; ++i) {
+        const gchar *key_end = static_cast<const gchar *>(memchr(p, '\0', end - p));
+        if (!key_end || size_t(end - key_end - 1) < data_size)
+            return false;
+        buffer_[i] = p - data;
+        p = key_end + 1 + data_size;
+    }
+    buffer_[count] = p - data;
+
+    CacheFile::save(url, ".oft", magic, [this](FILE *out) {
+        return fwrite(&buffer_[0], sizeof(buffer_[0]), buffer_.size(), out) == buffer_.size();
+    });
+    return attach(reinterpret_cast<const gchar *>(&buffer_[0]), buffer_.size() * sizeof(buffer_[0]),
+                  data, size, count, data_size);
+}
+
+bool KeyOffsets::attach(const gchar *offsets, size_t offsets_size, const gchar *data, size_t size,
+                        gulong count, size_t data_size)
+{
+    if (offsets_size != (count + 1) * sizeof(guint32))
+        return false;
+    offsets_ = offsets;
+    size_ = count + 1;
+    // a bad cache or cache of other file should not give keys out of data,
+    // there should be place for '\0' and data_size bytes after every key
+    bool valid = (*this)[0] == 0 && (*this)[count] <= size;
+    for (gulong i = 0; valid && i < count; ++i)
+        valid = (*this)[i] < (*this)[i + 1] && (*this)[i + 1] - (*this)[i] > data_size;
+    if (!valid) {
+        offsets_ = nullptr;
+        size_ = 0;
+        return false;
+    }
+    data_ = data;
+    data_size_ = data_size;
+    return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include "cache_file.hpp"
+
+//offsets of keys in index or synonym file which are loaded in memory,
+//the last offset is the end of keys; they are kept in cache, so next
+//time they are just mapped instead of scanning of all keys.
+//Only offsets are checked when cache is mapped, end of key is checked when it is read
+class KeyOffsets
+{
+public:
+    KeyOffsets() {}
+    KeyOffsets(const KeyOffsets &) = delete;
+    KeyOffsets &operator=(const KeyOffsets &) = delete;
+
+    //find count keys in data of url, after every key there are data_size bytes,
+    //returns false if data does not consist of such keys
+    bool load(const std::string &url, const gchar *data, size_t size, gulong count, size_t data_size);
+    guint32 operator[](gulong i) const
+    {
+        guint32 res;
+        memcpy(&res, offsets_ + i * sizeof(guint32), sizeof(guint32));
+        return res;
+    }
+    //number of keys plus one
+    gulong size() const { return size_; }
+    //key i, which is empty if cache is broken and it is not followed by '\0'
+    const gchar *key(gulong i) const
+    {
+        return data_[(*this)[i + 1] - data_size_ - 1] == '\0' ? data_ + (*this)[i] : "";
+    }
+    //data_size bytes after key i
+    const gchar *data(gulong i) const { return data_ + (*this)[i + 1] - data_size_; }
+
+private:
+    CacheFile cache_;
+    std::vector<guint32> buffer_;
+    const gchar *offsets_ = nullptr;
+    gulong size_ = 0;
+    const gchar *data_ = nullptr;
+    size_t data_size_ = 0;
+
+    bool attach(const gchar *offsets, size_t offsets_size, const gchar *data, size_t size,
+                gulong count, size_t data_size);
+};
@@ -197,60 +197,201 @@ static std::string parse_data(const gchar *data, bool colorize_output)
     return res;
 }
 
-void Library::SimpleLookup(const std::string &str, TSearchResultList &res_list)
+void Library::append_dict_results(int idict, const std::set<glong> &wordIdxs, TSearchResultList &res_list)
 {
-    std::set<glong> wordIdxs;
-    res_list.reserve(ndicts());
-    for (gint idict = 0; idict < ndicts(); ++idict) {
-        wordIdxs.clear();
-        if (SimpleLookupWord(str.c_str(), wordIdxs, idict))
-            for (auto &wordIdx : wordIdxs)
-                res_list.push_back(
-                    TSearchResult(dict_name(idict),
-                                  poGetWord(wordIdx, idict),
-                                  parse_data(poGetWordData(wordIdx, idict),
-                                             colorize_output_)));
+    for (auto &wordIdx : wordIdxs) {
+        glib::CharStr data(poGetWordData(wordIdx, idict));
+        res_list.push_back(
+            TSearchResult(dict_name(idict),
+                          poGetWord(wordIdx, idict),
+                          parse_data(get_impl(data),
+                                     colorize_output_)));
     }
 }
 
-void Library::LookupWithFuzzy(const std::string &str, TSearchResultList &res_list)
+void Library::SimpleLookup(const std::string &str, TSearchResultList &res_list)
 {
-    static const int MAXFUZZY = 10;
+    // every dictionary is searched in its own task,
+    // results are merged in the order of dictionaries
+    std::vector<TSearchResultList> dict_res_list(ndicts());
+    pool().parallel_for(ndicts(), [this, &str, &dict_res_list](size_t idict) {
+        std::set<glong> wordIdxs;
+        if (SimpleLookupWord(str.c_str(), wordIdxs, idict))
+            append_dict_results(idict, wordIdxs, dict_res_list[idict]);
+    });
+    res_list.reserve(res_list.size() + ndicts());
+    for (TSearchResultList &dict_res : dict_res_list)
+        for (TSearchResult &res : dict_res)
+            res_list.push_back(std::move(res));
+}
 
-    gchar *fuzzy_res[MAXFUZZY];
-    if (!Libs::LookupWithFuzzy(str.c_str(), fuzzy_res, MAXFUZZY))
+void Library::append_hits(const std::vector<WordPos> &hits, TSearchResultList &res_list)
+{
+    if (expand_hits_) {
+        // every found word is shown the same way as SimpleLookup does,
+        // but all of them are looked up at once
+        std::vector<std::string> words;
+        for (const WordPos &hit : hits) {
+            const gchar *word = poGetWord(hit.second, hit.first);
+            if (words.empty() || words.back() != word)
+                words.push_back(word);
+        }
+        std::vector<const gchar *> word_ptrs;
+        for (const std::string &word : words)
+            word_ptrs.push_back(word.c_str());
+        std::vector<std::vector<std::set<glong>>> found;
+        LookupWords(word_ptrs, found);
+        for (size_t i = 0; i < words.size(); ++i)
+            append_word_results(words[i].c_str(), found, i, res_list);
         return;
+    }
 
-    for (gchar **p = fuzzy_res, **end = (fuzzy_res + MAXFUZZY); p != end && *p; ++p) {
-        SimpleLookup(*p, res_list);
-        g_free(*p);
+    // articles of neighbour hits in the same dictionary are read in one task
+    std::vector<std::pair<int, std::set<glong>>> groups;
+    for (const WordPos &hit : hits) {
+        if (groups.empty() || groups.back().first != hit.first)
+            groups.emplace_back(hit.first, std::set<glong>());
+        groups.back().second.insert(hit.second);
     }
+    std::vector<TSearchResultList> group_res_list(groups.size());
+    pool().parallel_for(groups.size(), [this, &groups, &group_res_list](size_t i) {
+        append_dict_results(groups[i].first, groups[i].second, group_res_list[i]);
+    });
+    for (TSearchResultList &group_res : group_res_list)
+        for (TSearchResult &res : group_res)
+            res_list.push_back(std::move(res));
+}
+
+void Library::append_word_results(const gchar *word, std::vector<std::vector<std::set<glong>>> &found, size_t i,
+                                  TSearchResultList &res_list)
+{
+    // the same as SimpleLookup
+    for (int idict = 0; idict < ndicts(); ++idict) {
+        std::set<glong> &wordIdxs = found[idict][i];
+        if (wordIdxs.empty() && fuzzy_)
+            LookupSimilarWord(word, wordIdxs, idict);
+        append_dict_results(idict, wordIdxs, res_list);
+    }
+}
+
+void Library::LookupWithFuzzy(const std::string &str, TSearchResultList &res_list)
+{
+    std::vector<WordPos> hits;
+    if (Libs::LookupWithFuzzy(str.c_str(), hits))
+        append_hits(hits, res_list);
 }
 
 void Library::LookupWithRule(const std::string &str, TSearchResultList &res_list)
 {
-    std::vector<gchar *> match_res((MAX_MATCH_ITEM_PER_LIB)*ndicts());
+    std::vector<WordPos> hits;
+    if (Libs::LookupWithRule(str.c_str(), hits))
+        append_hits(hits, res_list);
+}
 
-    const gint nfound = Libs::LookupWithRule(str.c_str(), &match_res[0]);
-    if (nfound == 0)
-        return;
+void Library::LookupWithPrefix(const std::string &str, TSearchResultList &res_list)
+{
+    std::vector<WordPos> hits;
+    if (Libs::LookupWithPrefix(str.c_str(), hits))
+        append_hits(hits, res_list);
+}
 
-    for (gint i = 0; i < nfound; ++i) {
-        SimpleLookup(match_res[i], res_list);
-        g_free(match_res[i]);
+void Library::LookupData(const std::string &str, TSearchResultList &res_list)
+{
+    std::vector<WordPos> hits;
+    if (Libs::LookupData(str.c_str(), hits))
+        append_hits(hits, res_list);
+}
+
+static void append_json_result(std::string &out, const TSearchResult &res)
+{
+    out += "{\"dict\": \"";
+    append_json_escaped(out, res.bookname);
+    out += "\",\"word\":\"";
+    append_json_escaped(out, res.def);
+    out += "\",\"definition\":\"";
+    append_json_escaped(out, res.exp);
+    out += "\"}";
+}
+
+void Library::append_json_results(std::string &out, const TSearchResultList &res_list)
+{
+    out += '[';
+    for (size_t i = 0; i < res_list.size(); ++i) {
+        if (i != 0)
+            out += ',';
+        append_json_result(out, res_list[i]);
     }
+    out += "]\n";
 }
 
-void Library::LookupData(const std::string &str, TSearchResultList &res_list)
+bool Library::process_batch(FILE *in, FILE *out)
 {
-    std::vector<std::vector<gchar *>> drl(ndicts());
-    if (!Libs::LookupData(str.c_str(), &drl[0]))
-        return;
-    for (int idict = 0; idict < ndicts(); ++idict)
-        for (gchar *res : drl[idict]) {
-            SimpleLookup(res, res_list);
-            g_free(res);
+    const size_t BATCH_BLOCK_SIZE = 64 * 1024;
+    // so many lines are looked up at once, see lookup
+    const size_t BATCH_LINES = 4096;
+
+    // buffers are reused for all lines
+    std::vector<std::string> lines(BATCH_LINES), queries(BATCH_LINES);
+    std::vector<char> converted(BATCH_LINES);
+    std::vector<TSearchResultList> res_lists;
+    std::string reply;
+    reply.reserve(2 * BATCH_BLOCK_SIZE);
+    for (;;) {
+        size_t nlines = 0;
+        for (; nlines < lines.size() && stdio_getline(in, lines[nlines]); ++nlines) {
+            const std::string &line = lines[nlines];
+            std::string &query = queries[nlines];
+            converted[nlines] = true;
+            if (utf8_input_) {
+                converted[nlines] = g_utf8_validate(line.data(), line.size(), nullptr);
+                if (converted[nlines])
+                    query = line;
+                else
+                    query.clear();
+                continue;
+            }
+            glib::Error err;
+            // with length of line, embedded '\0' is an error too
+            glib::CharStr str(g_locale_to_utf8(line.data(), line.size(), nullptr, nullptr, get_addr(err)));
+            if (nullptr == get_impl(str)) {
+                fprintf(stderr, _("Can not convert %s to utf8.\n"), line.c_str());
+                fprintf(stderr, "%s\n", err->message);
+                converted[nlines] = false;
+                query.clear();
+            } else {
+                query = get_impl(str);
+            }
         }
+        if (nlines == 0)
+            break;
+        queries.resize(nlines);
+        lookup(queries, res_lists);
+
+        for (size_t i = 0; i < nlines; ++i) {
+            reply += "{\"query\": \"";
+            // output should be valid UTF-8 even for lines which could not be converted
+            if (converted[i])
+                append_json_escaped(reply, queries[i]);
+            else
+                append_json_escaped(reply, utf8_input_ ? utf8_make_valid(lines[i]) : locale_to_utf8_ign_err(lines[i]));
+            reply += "\", \"results\": [";
+            for (size_t j = 0; j < res_lists[i].size(); ++j) {
+                if (j != 0)
+                    reply += ',';
+                append_json_result(reply, res_lists[i][j]);
+            }
+            reply += "]}\n";
+
+            if (reply.size() >= BATCH_BLOCK_SIZE) {
+                if (fwrite(reply.data(), 1, reply.size(), out) != reply.size())
+                    return false;
+                reply.clear();
+            }
+        }
+        if (nlines < lines.size())
+            break;
+    }
+    return fwrite(reply.data(), 1, reply.size(), out) == reply.size() && fflush(out) == 0;
 }
 
 void Library::print_search_result(FILE *out, const TSearchResult &res, bool &first_result)
@@ -268,11 +409,9 @@ void Library::print_search_result(FILE *out, const TSearchResult &res, bool &fir
         } else {
             first_result = false;
         }
-        fprintf(out, "{\"dict\": \"%s\",\"word\":\"%s\",\"definition\":\"%s\"}",
-                json_escape_string(res.bookname).c_str(),
-                json_escape_string(res.def).c_str(),
-                json_escape_string(res.exp).c_str());
-
+        std::string json;
+        append_json_result(json, res);
+        fputs(json.c_str(), out);
     } else {
         fprintf(out,
                 "-->%s%s%s\n"
@@ -288,6 +427,33 @@ void Library::print_search_result(FILE *out, const TSearchResult &res, bool &fir
     }
 }
 
+void Library::lookup(const char *str, TSearchResultList &res_list)
+{
+    std::string query;
+
+    switch (analyze_query(str, query)) {
+    case qtFUZZY:
+        LookupWithFuzzy(query, res_list);
+        break;
+    case qtREGEXP:
+        LookupWithRule(query, res_list);
+        break;
+    case qtSIMPLE:
+        SimpleLookup(str, res_list);
+        if (res_list.empty() && fuzzy_)
+            LookupWithFuzzy(str, res_list);
+        break;
+    case qtDATA:
+        LookupData(query, res_list);
+        break;
+    case qtPREFIX:
+        LookupWithPrefix(query, res_list);
+        break;
+    default:
+        /*nothing*/;
+    }
+}
+
 namespace
 {
 class sdcv_pager final
@@ -320,6 +486,38 @@ private:
 };
 } // namespace
 
+void Library::lookup(const std::vector<std::string> &strs, std::vector<TSearchResultList> &res_lists)
+{
+    // exact lookups of all simple queries are done at once
+    const size_t NOT_SIMPLE = size_t(-1);
+    std::vector<const gchar *> words;
+    std::vector<size_t> word_of(strs.size(), NOT_SIMPLE);
+    std::string query;
+    for (size_t i = 0; i < strs.size(); ++i)
+        if (!strs[i].empty() && analyze_query(strs[i].c_str(), query) == qtSIMPLE) {
+            word_of[i] = words.size();
+            words.push_back(strs[i].c_str());
+        }
+    std::vector<std::vector<std::set<glong>>> found;
+    LookupWords(words, found);
+
+    res_lists.resize(strs.size());
+    pool().parallel_for(strs.size(), [this, &strs, &word_of, &found, &res_lists](size_t i) {
+        TSearchResultList &res_list = res_lists[i];
+        res_list.clear();
+        if (strs[i].empty())
+            return;
+        if (word_of[i] == NOT_SIMPLE) {
+            lookup(strs[i].c_str(), res_list);
+            return;
+        }
+        // the same as fuzzy search after SimpleLookup in lookup
+        append_word_results(strs[i].c_str(), found, word_of[i], res_list);
+        if (res_list.empty() && fuzzy_)
+            LookupWithFuzzy(strs[i], res_list);
+    });
+}
+
 search_result Library::process_phrase(const char *loc_str, IReadLine &io, bool force)
 {
     if (nullptr == loc_str)
@@ -351,25 +549,7 @@ search_result Library::process_phrase(const char *loc_str, IReadLine &io, bool f
         return SEARCH_SUCCESS;
 
     TSearchResultList res_list;
-
-    switch (analyze_query(get_impl(str), query)) {
-    case qtFUZZY:
-        LookupWithFuzzy(query, res_list);
-        break;
-    case qtREGEXP:
-        LookupWithRule(query, res_list);
-        break;
-    case qtSIMPLE:
-        SimpleLookup(get_impl(str), res_list);
-        if (res_list.empty() && fuzzy_)
-            LookupWithFuzzy(get_impl(str), res_list);
-        break;
-    case qtDATA:
-        LookupData(query, res_list);
-        break;
-    default:
-        /*nothing*/;
-    }
+    lookup(get_impl(str), res_list);
 
     bool first_result = true;
     if (json_) {
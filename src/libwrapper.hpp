@@ -45,17 +45,41 @@ public:
         setFuzzy(!no_fuzzy);
     }
 
+    //show articles of words found by fuzzy, pattern and data search in all
+    //dictionaries, as for simple search, not only the found articles
+    void setExpandHits(bool expand) { expand_hits_ = expand; }
+
     search_result process_phrase(const char *loc_str, IReadLine &io, bool force = false);
+    //search for utf8 string without any output, the same way as process_phrase
+    void lookup(const char *str, TSearchResultList &res_list);
+    //the same for every of strs, res_lists[i] gets results for strs[i];
+    //exact lookups of all simple queries are done at once, see Libs::LookupWords
+    void lookup(const std::vector<std::string> &strs, std::vector<TSearchResultList> &res_lists);
+    //format results the same way as --json does, including trailing newline
+    static void append_json_results(std::string &out, const TSearchResultList &res_list);
+    //answer every line of in with one line of JSON {"query": line, "results": [...]},
+    //results are the same as --json gives for line, out is written by big blocks;
+    //false if out can not be written
+    bool process_batch(FILE *in, FILE *out);
 
 private:
     bool utf8_input_;
     bool utf8_output_;
     bool colorize_output_;
     bool json_;
+    bool expand_hits_ = false;
 
+    void append_dict_results(int idict, const std::set<glong> &wordIdxs, TSearchResultList &res_list);
+    //results of words with given places, see setExpandHits
+    void append_hits(const std::vector<WordPos> &hits, TSearchResultList &res_list);
+    //results of the i-th of words looked up with LookupWords, similar words are
+    //searched in dictionaries where it is not found
+    void append_word_results(const gchar *word, std::vector<std::vector<std::set<glong>>> &found, size_t i,
+                             TSearchResultList &res_list);
     void SimpleLookup(const std::string &str, TSearchResultList &res_list);
     void LookupWithFuzzy(const std::string &str, TSearchResultList &res_list);
     void LookupWithRule(const std::string &str, TSearchResultList &res_lsit);
+    void LookupWithPrefix(const std::string &str, TSearchResultList &res_list);
     void LookupData(const std::string &str, TSearchResultList &res_list);
     void print_search_result(FILE *out, const TSearchResult &res, bool &first_result);
 };
@@ -9,6 +9,7 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 #endif
 #ifdef _WIN32
 #include <windows.h>
@@ -22,8 +23,12 @@ public:
     ~MapFile();
     MapFile(const MapFile &) = delete;
     MapFile &operator=(const MapFile &) = delete;
+    //previous file is closed
     bool open(const char *file_name, off_t file_size);
+    void close();
     gchar *begin() { return data; }
+    //data will be read soon and in random order, it is only a hint for kernel
+    void advise_random_access();
 
 private:
     char *data = nullptr;
@@ -38,6 +43,7 @@ private:
 
 inline bool MapFile::open(const char *file_name, off_t file_size)
 {
+    close();
 #ifdef HAVE_MMAP
     if ((mmap_fd = ::open(file_name, O_RDONLY)) < 0) {
         // g_print("Open file %s failed!\n",fullfilename);
@@ -46,7 +52,8 @@ inline bool MapFile::open(const char *file_name, off_t file_size)
     struct stat st;
     if (fstat(mmap_fd, &st) == -1 || st.st_size < 0 || (st.st_size == 0 && S_ISREG(st.st_mode))
         || st.st_size != file_size) {
-        close(mmap_fd);
+        ::close(mmap_fd);
+        mmap_fd = -1;
         return false;
     }
 
@@ -56,6 +63,8 @@ inline bool MapFile::open(const char *file_name, off_t file_size)
         // g_print("mmap file %s failed!\n",idxfilename);
         size = 0u;
         data = nullptr;
+        ::close(mmap_fd);
+        mmap_fd = -1;
         return false;
     }
 #elif defined(_WIN32)
@@ -67,27 +76,49 @@ inline bool MapFile::open(const char *file_name, off_t file_size)
     if (!g_file_get_contents(file_name, &data, &read_len, nullptr))
         return false;
 
-    if (read_len != file_size)
+    if (read_len != file_size) {
+        close();
         return false;
+    }
 #endif
 
     return true;
 }
 
-inline MapFile::~MapFile()
+inline void MapFile::advise_random_access()
+{
+#ifdef HAVE_MMAP
+    if (!data)
+        return;
+    posix_madvise(data, size, POSIX_MADV_WILLNEED);
+    posix_madvise(data, size, POSIX_MADV_RANDOM);
+#endif
+}
+
+inline void MapFile::close()
 {
     if (!data)
         return;
 #ifdef HAVE_MMAP
     munmap(data, size);
-    close(mmap_fd);
+    ::close(mmap_fd);
+    size = 0u;
+    mmap_fd = -1;
 #else
 #ifdef _WIN32
     UnmapViewOfFile(data);
     CloseHandle(hFileMap);
     CloseHandle(hFile);
+    hFileMap = 0;
+    hFile = 0;
 #else
     g_free(data);
 #endif
 #endif
+    data = nullptr;
+}
+
+inline MapFile::~MapFile()
+{
+    close();
 }
@@ -0,0 +1,105 @@
+/*
+ * This file part of sdcv - console version of Stardict program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <deque>
+
+#include "multi_matcher.hpp"
+
+namespace
+{
+const size_t ALPHABET_SIZE = 256;
+const guint32 NO_STATE = guint32(-1);
+} // namespace
+
+MultiMatcher::MultiMatcher(const std::vector<std::string> &words)
+    : nwords_(words.size())
+    , next_(ALPHABET_SIZE, NO_STATE)
+    , outputs_(1)
+{
+    // trie of words
+    for (size_t i = 0; i < words.size(); ++i) {
+        guint32 state = 0;
+        for (unsigned char ch : words[i]) {
+            guint32 &to = next_[state * ALPHABET_SIZE + ch];
+            if (to == NO_STATE) {
+                to = outputs_.size();
+                outputs_.emplace_back();
+                next_.resize(next_.size() + ALPHABET_SIZE, NO_STATE);
+            }
+            state = next_[state * ALPHABET_SIZE + ch];
+        }
+        outputs_[state].push_back(i);
+    }
+
+    // turn trie into automaton, states are visited in order of depth,
+    // so the failure state of every state is ready before it
+    std::vector<guint32> fail(outputs_.size(), 0);
+    std::deque<guint32> queue;
+    for (size_t ch = 0; ch < ALPHABET_SIZE; ++ch) {
+        guint32 &to = next_[ch];
+        if (to == NO_STATE)
+            to = 0;
+        else
+            queue.push_back(to);
+    }
+    while (!queue.empty()) {
+        const guint32 state = queue.front();
+        queue.pop_front();
+        const std::vector<guint32> &fail_outputs = outputs_[fail[state]];
+        outputs_[state].insert(outputs_[state].end(), fail_outputs.begin(), fail_outputs.end());
+        for (size_t ch = 0; ch < ALPHABET_SIZE; ++ch) {
+            guint32 &to = next_[state * ALPHABET_SIZE + ch];
+            const guint32 fail_to = next_[fail[state] * ALPHABET_SIZE + ch];
+            if (to == NO_STATE) {
+                to = fail_to;
+            } else {
+                fail[to] = fail_to;
+                queue.push_back(to);
+            }
+        }
+    }
+
+    // rows of transitions are addressed directly, without multiplication
+    for (guint32 &to : next_)
+        to *= ALPHABET_SIZE;
+    has_output_.resize(outputs_.size());
+    for (size_t state = 0; state < outputs_.size(); ++state)
+        has_output_[state] = !outputs_[state].empty();
+}
+
+bool MultiMatcher::scan(const gchar *text, size_t len, std::vector<bool> &found, size_t &nfound) const
+{
+    guint32 row = 0;
+    for (const gchar *p = text, *end = text + len; p < end; ++p) {
+        row = next_[row + static_cast<unsigned char>(*p)];
+        if (!has_output_[row / ALPHABET_SIZE])
+            continue;
+        for (guint32 word : outputs_[row / ALPHABET_SIZE]) {
+            if (found[word])
+                continue;
+            found[word] = true;
+            if (++nfound == nwords_)
+                return true;
+        }
+    }
+    return nfound == nwords_;
+}
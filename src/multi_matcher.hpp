@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+//Aho-Corasick automaton, it finds occurrences of several words
+//with one pass over text
+class MultiMatcher
+{
+public:
+    explicit MultiMatcher(const std::vector<std::string> &words);
+    MultiMatcher(const MultiMatcher &) = delete;
+    MultiMatcher &operator=(const MultiMatcher &) = delete;
+
+    size_t size() const { return nwords_; }
+    //mark words which occur in text, nfound is number of marked words,
+    //returns true if all words are found
+    bool scan(const gchar *text, size_t len, std::vector<bool> &found, size_t &nfound) const;
+
+private:
+    size_t nwords_;
+    //transitions of every state for every byte, as offset of row of the next state
+    std::vector<guint32> next_;
+    std::vector<guint8> has_output_;
+    //words which end in state, including words ending in its suffixes
+    std::vector<std::vector<guint32>> outputs_;
+};
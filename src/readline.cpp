@@ -24,6 +24,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #ifdef WITH_READLINE
 #include <readline/history.h>
 #include <readline/readline.h>
@@ -42,7 +43,8 @@ bool stdio_getline(FILE *in, std::string &str)
     while ((ch = fgetc(in)) != EOF && ch != '\n')
         str += ch;
 
-    return EOF != ch;
+    // the last line without '\n'
+    return EOF != ch || !str.empty();
 }
 
 #ifndef WITH_READLINE
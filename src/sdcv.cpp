@@ -37,8 +37,11 @@
 #include <glib/gi18n.h>
 #include <glib/gstdio.h>
 
+#include "chunk_cache.hpp"
+#include "dict_catalog.hpp"
 #include "libwrapper.hpp"
 #include "readline.hpp"
+#include "server.hpp"
 #include "utils.hpp"
 
 static const char gVersion[] = VERSION;
@@ -78,11 +81,21 @@ try {
     gboolean non_interactive = FALSE;
     gboolean json_output = FALSE;
     gboolean no_fuzzy = FALSE;
+    gint fuzzy_limit = MAX_FUZZY_WORDS;
+    gboolean expand_hits = FALSE;
     gboolean utf8_output = FALSE;
     gboolean utf8_input = FALSE;
     glib::CharStr opt_data_dir;
     gboolean only_data_dir = FALSE;
     gboolean colorize = FALSE;
+    glib::CharStr server_socket;
+    gint threads = 1;
+    gboolean data_index = FALSE;
+    gboolean hash_index = FALSE;
+    gboolean trie_index = FALSE;
+    gint cache_size = -1;
+    gboolean lazy_load = FALSE;
+    glib::CharStr batch_file;
     glib::StrArr word_list;
 
     const GOptionEntry entries[] = {
@@ -101,6 +114,11 @@ try {
           _("print the result formatted as JSON"), nullptr },
         { "exact-search", 'e', 0, G_OPTION_ARG_NONE, &no_fuzzy,
           _("do not fuzzy-search for similar words, only return exact matches"), nullptr },
+        { "fuzzy-limit", 0, 0, G_OPTION_ARG_INT, &fuzzy_limit,
+          _("show articles of at most this number of similar words found by fuzzy search"),
+          _("N") },
+        { "expand-hits", 0, 0, G_OPTION_ARG_NONE, &expand_hits,
+          _("show articles of words found by fuzzy, pattern, prefix or data search from all dictionaries"), nullptr },
         { "utf8-output", '0', 0, G_OPTION_ARG_NONE, &utf8_output,
           _("output must be in utf8"), nullptr },
         { "utf8-input", '1', 0, G_OPTION_ARG_NONE, &utf8_input,
@@ -112,6 +130,26 @@ try {
           _("only use the dictionaries in data-dir, do not search in user and system directories"), nullptr },
         { "color", 'c', 0, G_OPTION_ARG_NONE, &colorize,
           _("colorize the output"), nullptr },
+        { "server", 0, 0, G_OPTION_ARG_FILENAME, get_addr(server_socket),
+          _("answer queries from clients of this unix domain socket, with JSON output"),
+          _("path/to/socket") },
+        { "threads", 0, 0, G_OPTION_ARG_INT, &threads,
+          _("search in dictionaries with this number of threads, 0 means one per processor"),
+          _("N") },
+        { "data-index", 0, 0, G_OPTION_ARG_NONE, &data_index,
+          _("use index of words of articles for data search, it is built at the first search"), nullptr },
+        { "hash-index", 0, 0, G_OPTION_ARG_NONE, &hash_index,
+          _("use hash of words for exact search, it is built at the first search"), nullptr },
+        { "trie-index", 0, 0, G_OPTION_ARG_NONE, &trie_index,
+          _("use trie of words for exact and prefix search, it is built at the first search"), nullptr },
+        { "cache-size", 0, 0, G_OPTION_ARG_INT, &cache_size,
+          _("keep this number of megabytes of uncompressed dictionary data in memory"),
+          _("MB") },
+        { "lazy-load", 0, 0, G_OPTION_ARG_NONE, &lazy_load,
+          _("read only .ifo files at start, open other files of dictionary at first search in it"), nullptr },
+        { "batch", 0, 0, G_OPTION_ARG_FILENAME, get_addr(batch_file),
+          _("search every line of file, - means stdin, and print one line of JSON for each"),
+          _("file") },
         { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, get_addr(word_list),
           _("search terms"), _(" words") },
         {},
@@ -134,6 +172,25 @@ try {
         return EXIT_SUCCESS;
     }
 
+    if (threads < 0) {
+        fprintf(stderr, _("Invalid number of threads: %d\n"), threads);
+        return EXIT_FAILURE;
+    }
+    if (threads == 0)
+        threads = g_get_num_processors();
+
+    if (fuzzy_limit <= 0) {
+        fprintf(stderr, _("Invalid number of similar words: %d\n"), fuzzy_limit);
+        return EXIT_FAILURE;
+    }
+
+    if (cache_size < 0) {
+        const gchar *cache_size_str = g_getenv("SDCV_CACHE_SIZE");
+        if (!cache_size_str || sscanf(cache_size_str, "%d", &cache_size) < 1 || cache_size < 0)
+            cache_size = ChunkCache::DEFAULT_CAPACITY / (1024 * 1024);
+    }
+    ChunkCache::instance().set_capacity(size_t(cache_size) * 1024 * 1024);
+
     const gchar *stardict_data_dir = g_getenv("STARDICT_DATA_DIR");
     std::string data_dir;
     if (!opt_data_dir) {
@@ -160,17 +217,25 @@ try {
         return EXIT_SUCCESS;
     }
 
+    const bool server_mode = server_socket != nullptr;
+    const bool batch_mode = batch_file != nullptr;
+    Library lib(utf8_input || server_mode, utf8_output || server_mode || batch_mode, colorize,
+                json_output || server_mode || batch_mode, no_fuzzy);
+    lib.setThreads(threads);
+    lib.setDataIndex(data_index);
+    lib.setHashIndex(hash_index);
+    lib.setTrieIndex(trie_index);
+    lib.setLazy(lazy_load);
+    lib.setFuzzyLimit(fuzzy_limit);
+    lib.setExpandHits(expand_hits);
+
     std::list<std::string> disable_list;
 
+    std::vector<DictInfo> dict_infos;
+    lib.load_dict_infos(dicts_dir_list, dict_infos);
     std::map<std::string, std::string> bookname_to_ifo;
-    for_each_file(dicts_dir_list, ".ifo", std::list<std::string>(), std::list<std::string>(),
-                  [&bookname_to_ifo](const std::string &fname, bool) {
-                      DictInfo dict_info;
-                      const bool load_ok = dict_info.load_from_ifo_file(fname, false);
-                      if (!load_ok)
-                          return;
-                      bookname_to_ifo[dict_info.bookname] = dict_info.ifo_file_name;
-                  });
+    for (const DictInfo &dict_info : dict_infos)
+        bookname_to_ifo[dict_info.bookname] = dict_info.ifo_file_name;
 
     std::list<std::string> order_list;
     if (use_dict_list != nullptr) {
@@ -219,8 +284,25 @@ try {
         fprintf(stderr, _("g_mkdir failed: %s\n"), strerror(errno));
     }
 
-    Library lib(utf8_input, utf8_output, colorize, json_output, no_fuzzy);
-    lib.load(dicts_dir_list, order_list, disable_list);
+    lib.load(dict_infos, order_list, disable_list);
+
+    if (server_mode) {
+        QueryServer server(lib, get_impl(server_socket));
+        return server.run() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (batch_mode) {
+        const bool use_stdin = strcmp(get_impl(batch_file), "-") == 0;
+        FILE *in = use_stdin ? stdin : g_fopen(get_impl(batch_file), "r");
+        if (in == nullptr) {
+            fprintf(stderr, _("Can not open %s: %s\n"), get_impl(batch_file), strerror(errno));
+            return EXIT_FAILURE;
+        }
+        const bool written = lib.process_batch(in, stdout);
+        if (!use_stdin)
+            fclose(in);
+        return written ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
     std::unique_ptr<IReadLine> io(create_readline_object());
     if (word_list != nullptr) {
@@ -260,24 +342,21 @@ static void list_dicts(const std::list<std::string> &dicts_dir_list, bool use_js
         printf(_("Dictionary's name   Word count\n"));
     else
         fputc('[', stdout);
-    std::list<std::string> order_list, disable_list;
-    for_each_file(dicts_dir_list, ".ifo", order_list,
-                  disable_list, [use_json, &first_entry](const std::string &filename, bool) -> void {
-                      DictInfo dict_info;
-                      if (dict_info.load_from_ifo_file(filename, false)) {
-                          const std::string bookname = utf8_to_locale_ign_err(dict_info.bookname);
-                          if (use_json) {
-                              if (first_entry) {
-                                  first_entry = false;
-                              } else {
-                                  fputc(',', stdout); // comma between entries
-                              }
-                              printf("{\"name\": \"%s\", \"wordcount\": \"%d\"}", json_escape_string(bookname).c_str(), dict_info.wordcount);
-                          } else {
-                              printf("%s    %d\n", bookname.c_str(), dict_info.wordcount);
-                          }
-                      }
-                  });
+    std::vector<DictInfo> dict_infos;
+    DictCatalog(dicts_dir_list).load(nullptr, dict_infos);
+    for (const DictInfo &dict_info : dict_infos) {
+        const std::string bookname = utf8_to_locale_ign_err(dict_info.bookname);
+        if (use_json) {
+            if (first_entry) {
+                first_entry = false;
+            } else {
+                fputc(',', stdout); // comma between entries
+            }
+            printf("{\"name\": \"%s\", \"wordcount\": \"%d\"}", json_escape_string(bookname).c_str(), dict_info.wordcount);
+        } else {
+            printf("%s    %d\n", bookname.c_str(), dict_info.wordcount);
+        }
+    }
     if (use_json)
         fputs("]\n", stdout);
 }
@@ -0,0 +1,220 @@
+/*
+ * This file part of sdcv - console version of Stardict program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <glib/gi18n.h>
+
+#include "chunk_cache.hpp"
+#include "libwrapper.hpp"
+
+#include "server.hpp"
+
+namespace
+{
+// client which sends endless line is disconnected
+const size_t MAX_QUERY_LEN = 64 * 1024;
+
+volatile sig_atomic_t stop_requested = 0;
+volatile sig_atomic_t stats_requested = 0;
+
+extern "C" void on_stop_signal(int)
+{
+    stop_requested = 1;
+}
+
+extern "C" void on_stats_signal(int)
+{
+    stats_requested = 1;
+}
+
+void print_cache_stats()
+{
+    const ChunkCache::Stats stats = ChunkCache::instance().stats();
+    fprintf(stderr, _("chunk cache: %lu chunks, %lu of %lu bytes, %llu hits, %llu misses, %llu evictions\n"),
+            static_cast<unsigned long>(stats.nchunks), static_cast<unsigned long>(stats.size),
+            static_cast<unsigned long>(stats.capacity), static_cast<unsigned long long>(stats.hits),
+            static_cast<unsigned long long>(stats.misses), static_cast<unsigned long long>(stats.evictions));
+}
+
+bool write_all(int fd, const char *p, size_t len)
+{
+    while (len > 0) {
+        const ssize_t n = ::write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+} // namespace
+
+void QueryServer::answer(const std::string &query, std::string &reply)
+{
+    TSearchResultList res_list;
+    if (!query.empty())
+        lib_.lookup(query.c_str(), res_list);
+    Library::append_json_results(reply, res_list);
+}
+
+void QueryServer::serve_client(int fd)
+{
+    std::string buf, reply;
+    char chunk[4096];
+    for (;;) {
+        const ssize_t n = ::read(fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        buf.append(chunk, n);
+
+        reply.clear();
+        std::string::size_type begin = 0, end;
+        while ((end = buf.find('\n', begin)) != std::string::npos) {
+            std::string query(buf, begin, end - begin);
+            if (!query.empty() && query[query.size() - 1] == '\r')
+                query.erase(query.size() - 1);
+            answer(query, reply);
+            begin = end + 1;
+        }
+        buf.erase(0, begin);
+        if (!reply.empty() && !write_all(fd, reply.data(), reply.size()))
+            break;
+        if (buf.size() > MAX_QUERY_LEN)
+            break;
+    }
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    clients_.erase(fd);
+    ::close(fd);
+    clients_cv_.notify_all();
+}
+
+bool QueryServer::run()
+{
+    sockaddr_un addr;
+    if (socket_path_.size() >= sizeof(addr.sun_path)) {
+        fprintf(stderr, _("Socket path is too long: %s\n"), socket_path_.c_str());
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path_.c_str(), sizeof(addr.sun_path) - 1);
+
+    // remove socket left by previous instance, but never other files
+    struct stat st;
+    if (lstat(socket_path_.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(socket_path_.c_str());
+
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        fprintf(stderr, _("socket failed: %s\n"), strerror(errno));
+        return false;
+    }
+    if (bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0
+        || listen(listen_fd, SOMAXCONN) != 0) {
+        fprintf(stderr, _("Can not listen on %s: %s\n"), socket_path_.c_str(), strerror(errno));
+        ::close(listen_fd);
+        return false;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    // no SA_RESTART, so pselect returns EINTR and we can stop
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    // statistics of cache for monitoring
+    sa.sa_handler = on_stats_signal;
+    sigaction(SIGUSR1, &sa, nullptr);
+
+    sigset_t server_signals, old_mask;
+    sigemptyset(&server_signals);
+    sigaddset(&server_signals, SIGINT);
+    sigaddset(&server_signals, SIGTERM);
+    sigaddset(&server_signals, SIGUSR1);
+    // signals are delivered only while waiting in pselect, so signal which comes
+    // after check of stop_requested is not lost, and threads of clients
+    // inherit the mask and never handle them
+    pthread_sigmask(SIG_BLOCK, &server_signals, &old_mask);
+    // client may go away between pselect and accept, accept should not block then
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+
+    while (!stop_requested) {
+        if (stats_requested) {
+            stats_requested = 0;
+            print_cache_stats();
+        }
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(listen_fd, &readable);
+        if (pselect(listen_fd + 1, &readable, nullptr, nullptr, nullptr, &old_mask) < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, _("select failed: %s\n"), strerror(errno));
+            break;
+        }
+        const int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN || errno == EWOULDBLOCK)
+                continue;
+            fprintf(stderr, _("accept failed: %s\n"), strerror(errno));
+            break;
+        }
+        // accepted socket may inherit O_NONBLOCK, but clients are served with blocking reads
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex_);
+            clients_.insert(fd);
+        }
+        std::thread(&QueryServer::serve_client, this, fd).detach();
+    }
+    pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+
+    ::close(listen_fd);
+    unlink(socket_path_.c_str());
+
+    // wake up clients blocked in read and wait for them to finish
+    std::unique_lock<std::mutex> lock(clients_mutex_);
+    for (int fd : clients_)
+        shutdown(fd, SHUT_RDWR);
+    clients_cv_.wait(lock, [this]() { return clients_.empty(); });
+
+    return stop_requested != 0;
+}
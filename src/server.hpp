@@ -0,0 +1,37 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+
+class Library;
+
+//serve queries from clients connected to unix domain socket,
+//one query per line, every query is answered with one line
+//of JSON in the same format as --json output
+class QueryServer
+{
+public:
+    QueryServer(Library &lib, const std::string &socket_path)
+        : lib_(lib)
+        , socket_path_(socket_path)
+    {
+    }
+    QueryServer(const QueryServer &) = delete;
+    QueryServer &operator=(const QueryServer &) = delete;
+
+    //accept connections until SIGINT or SIGTERM,
+    //statistics of cache is printed to stderr on SIGUSR1
+    bool run();
+
+private:
+    Library &lib_;
+    std::string socket_path_;
+    std::mutex clients_mutex_;
+    std::condition_variable clients_cv_;
+    std::set<int> clients_;
+
+    void serve_client(int fd);
+    void answer(const std::string &query, std::string &reply);
+};
@@ -3,15 +3,22 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <cerrno>
 #include <cstring>
 #include <map>
 #include <stdexcept>
+#include <unordered_map>
 
+#include <fcntl.h>
 #include <glib/gstdio.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <zlib.h>
 
+#include "cache_file.hpp"
+#include "dict_catalog.hpp"
 #include "distance.hpp"
 #include "mapfile.hpp"
 #include "utils.hpp"
@@ -34,10 +41,37 @@
 namespace
 {
 struct Fuzzystruct {
-    char *pMatchWord;
     int iMatchWordDistance;
+    // difference of lengths of the word and of the searched one
+    int iLenDif;
+    // dictionary and index of the word
+    guint64 iPos;
+
+    int iLib() const { return int(iPos >> 32); }
+    glong index() const { return glong(iPos & 0xFFFFFFFF); }
 };
 
+// fuzzy search splits dictionaries into parts of this size,
+// it does not depend on number of threads, so results are always the same
+const glong FUZZY_CHUNK_SIZE = 16 * 1024;
+// articles are searched by pieces of about this size
+const guint32 DATA_CHUNK_SIZE = 1024 * 1024;
+
+// end of piece of entries sorted by offset, which starts from entry from
+size_t next_data_chunk(const std::vector<DataEntry> &entries, size_t from)
+{
+    size_t to = from + 1;
+    guint32 chunk_end = entries[from].offset + entries[from].size;
+    while (to < entries.size()) {
+        const guint32 entry_end = std::max(chunk_end, entries[to].offset + entries[to].size);
+        if (entry_end - entries[from].offset > DATA_CHUNK_SIZE)
+            break;
+        chunk_end = entry_end;
+        ++to;
+    }
+    return to;
+}
+
 static inline bool bIsVowel(gchar inputchar)
 {
     gchar ch = g_ascii_toupper(inputchar);
@@ -72,6 +106,130 @@ static void unicode_strdown(gunichar *str)
         ++str;
     }
 }
+
+//call on_match(i, j) for every key j equal to strs[i], strs should be sorted
+//by stardict_strcmp as keys are; keys are walked only forward and the first key
+//not less than strs[i] is found with galloping from the one of strs[i - 1],
+//so close strs cost a few comparisons and far ones cost a binary search
+template <typename GetKey, typename OnMatch>
+void merge_lookup(glong nkeys, const GetKey &get_key, const char *const *strs, size_t nstrs, const OnMatch &on_match)
+{
+    glong from = 0;
+    for (size_t i = 0; i < nstrs && from < nkeys; ++i) {
+        const char *str = strs[i];
+        // keys before lo are less than str, key at hi is not or hi is the end
+        glong lo = from, hi = from, step = 1;
+        while (hi < nkeys && stardict_strcmp(get_key(hi), str) < 0) {
+            lo = hi + 1;
+            hi += step;
+            step *= 2;
+        }
+        hi = std::min(hi, nkeys);
+        while (lo < hi) {
+            const glong mid = lo + (hi - lo) / 2;
+            if (stardict_strcmp(get_key(mid), str) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        from = lo;
+        for (glong j = from; j < nkeys && stardict_strcmp(str, get_key(j)) == 0; ++j)
+            on_match(i, j);
+    }
+}
+
+//keys which start with len bytes of prefix if case of ASCII letters is ignored
+//are in one range, because keys are sorted by stardict_strcmp; its start is
+//found with binary search
+template <typename GetKey>
+glong prefix_range_start(glong nkeys, const GetKey &get_key, const char *prefix, size_t len)
+{
+    glong lo = 0, hi = nkeys;
+    while (lo < hi) {
+        const glong mid = lo + (hi - lo) / 2;
+        if (g_ascii_strncasecmp(get_key(mid), prefix, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+//call on_key for every key of the first max_words different keys, which start
+//with prefix if case of ASCII letters is ignored; from is the start of their range
+template <typename GetKey, typename OnKey>
+void prefix_lookup(glong from, glong nkeys, const GetKey &get_key, const char *prefix, size_t max_words,
+                   const OnKey &on_key)
+{
+    const size_t len = strlen(prefix);
+    std::string prev;
+    size_t nwords = 0;
+    for (glong j = from; j < nkeys; ++j) {
+        const gchar *key = get_key(j);
+        if (g_ascii_strncasecmp(key, prefix, len) != 0)
+            break;
+        if (nwords == 0 || prev != key) {
+            if (nwords == max_words)
+                break;
+            ++nwords;
+            prev = key;
+        }
+        on_key(j, key);
+    }
+}
+
+template <typename GetKey, typename OnKey>
+void prefix_lookup(glong nkeys, const GetKey &get_key, const char *prefix, size_t max_words, const OnKey &on_key)
+{
+    prefix_lookup(prefix_range_start(nkeys, get_key, prefix, strlen(prefix)), nkeys, get_key, prefix, max_words, on_key);
+}
+
+//range of keys which are equal to str ignoring case of ASCII letters,
+//they go first among keys starting with str
+template <typename GetKey>
+void ascii_case_range(glong nkeys, const GetKey &get_key, const char *str, guint32 *from, guint32 *count)
+{
+    glong i = prefix_range_start(nkeys, get_key, str, strlen(str));
+    *from = i;
+    *count = 0;
+    for (; i < nkeys && g_ascii_strcasecmp(get_key(i), str) == 0; ++i)
+        ++*count;
+}
+
+//key is str with ASCII letters in case of form
+bool is_ascii_case_form(const gchar *key, const char *str, Dict::CaseForm form)
+{
+    for (size_t i = 0;; ++i) {
+        char c = str[i];
+        if (form == Dict::cfLOWER || (form == Dict::cfTITLE && i > 0))
+            c = g_ascii_tolower(c);
+        else if (form == Dict::cfUPPER || form == Dict::cfTITLE)
+            c = g_ascii_toupper(c);
+        if (key[i] != c)
+            return false;
+        if (c == '\0')
+            return true;
+    }
+}
+
+//str with letters in case of form
+std::string case_form(const char *str, Dict::CaseForm form)
+{
+    switch (form) {
+    case Dict::cfLOWER:
+        return get_impl(glib::CharStr(g_utf8_strdown(str, -1)));
+    case Dict::cfUPPER:
+        return get_impl(glib::CharStr(g_utf8_strup(str, -1)));
+    case Dict::cfTITLE: {
+        const gchar *nextchar = g_utf8_next_char(str);
+        glib::CharStr first(g_utf8_strup(str, nextchar - str));
+        glib::CharStr others(g_utf8_strdown(nextchar, -1));
+        return std::string(get_impl(first)) + get_impl(others);
+    }
+    default:
+        return str;
+    }
+}
 } // namespace
 
 bool DictInfo::load_from_ifo_file(const std::string &ifofilename,
@@ -169,24 +327,48 @@ bool DictInfo::load_from_ifo_file(const std::string &ifofilename,
     return true;
 }
 
-gchar *DictBase::GetWordData(guint32 idxitem_offset, guint32 idxitem_size)
+DictBase::~DictBase()
 {
-    for (int i = 0; i < WORDDATA_CACHE_NUM; i++)
-        if (cache[i].data && cache[i].offset == idxitem_offset)
-            return cache[i].data;
+    if (dictfd >= 0)
+        close(dictfd);
+}
 
-    if (dictfile)
-        fseek(dictfile, idxitem_offset, SEEK_SET);
+void DictBase::read_data(gchar *buf, guint32 offset, guint32 size)
+{
+    if (dictfd < 0) {
+        dictdzfile->read(buf, offset, size);
+        return;
+    }
+    // pread does not move file position, so several threads can read at once
+    while (size > 0) {
+        const ssize_t n = pread(dictfd, buf, size, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        THROW_IF_ERROR(n > 0);
+        buf += n;
+        offset += n;
+        size -= n;
+    }
+}
+
+gchar *DictBase::GetWordData(guint32 idxitem_offset, guint32 idxitem_size)
+{
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        for (int i = 0; i < WORDDATA_CACHE_NUM; i++)
+            if (cache[i].data && cache[i].offset == idxitem_offset) {
+                const guint32 data_size = get_uint32(cache[i].data);
+                gchar *data = (gchar *)g_malloc(data_size);
+                memcpy(data, cache[i].data, data_size);
+                return data;
+            }
+    }
 
     gchar *data;
     if (!sametypesequence.empty()) {
         glib::CharStr origin_data((gchar *)g_malloc(idxitem_size));
 
-        if (dictfile) {
-            const size_t nitems = fread(get_impl(origin_data), idxitem_size, 1, dictfile);
-            THROW_IF_ERROR(nitems == 1);
-        } else
-            dictdzfile->read(get_impl(origin_data), idxitem_offset, idxitem_size);
+        read_data(get_impl(origin_data), idxitem_offset, idxitem_size);
 
         guint32 data_size;
         gint sametypesequence_len = sametypesequence.length();
@@ -295,16 +477,17 @@ gchar *DictBase::GetWordData(guint32 idxitem_offset, guint32 idxitem_size)
         set_uint32(data, data_size);
     } else {
         data = (gchar *)g_malloc(idxitem_size + sizeof(guint32));
-        if (dictfile) {
-            const size_t nitems = fread(data + sizeof(guint32), idxitem_size, 1, dictfile);
-            THROW_IF_ERROR(nitems == 1);
-        } else
-            dictdzfile->read(data + sizeof(guint32), idxitem_offset, idxitem_size);
+        read_data(data + sizeof(guint32), idxitem_offset, idxitem_size);
         set_uint32(data, idxitem_size + sizeof(guint32));
     }
-    g_free(cache[cache_cur].data);
 
-    cache[cache_cur].data = data;
+    // cache keeps its own copy, because caller owns returned data
+    const guint32 data_size = get_uint32(data);
+    gchar *cached = (gchar *)g_malloc(data_size);
+    memcpy(cached, data, data_size);
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    g_free(cache[cache_cur].data);
+    cache[cache_cur].data = cached;
     cache[cache_cur].offset = idxitem_offset;
     cache_cur++;
     if (cache_cur == WORDDATA_CACHE_NUM)
@@ -312,26 +495,72 @@ gchar *DictBase::GetWordData(guint32 idxitem_offset, guint32 idxitem_size)
     return data;
 }
 
-bool DictBase::SearchData(std::vector<std::string> &SearchWords, guint32 idxitem_offset, guint32 idxitem_size, gchar *origin_data)
+void DictBase::read_articles(const DataEntry *begin, const DataEntry *end,
+                             const std::function<void(const DataEntry &, const gchar *)> &fn)
 {
-    int nWord = SearchWords.size();
-    std::vector<bool> WordFind(nWord, false);
-    int nfound = 0;
+    if (begin == end)
+        return;
+    if (dictdzfile) {
+        // only chunks of articles are inflated, not ones between them
+        std::vector<DictData::Range> ranges;
+        size_t total_size = 0;
+        for (const DataEntry *entry = begin; entry != end; ++entry) {
+            ranges.push_back({ entry->offset, entry->size, nullptr });
+            total_size += entry->size;
+        }
+        std::vector<gchar> data(total_size + 1);
+        size_t pos = 0;
+        for (DictData::Range &range : ranges) {
+            range.buffer = &data[pos];
+            pos += range.size;
+        }
+        dictdzfile->read(ranges.data(), ranges.data() + ranges.size());
+        for (const DataEntry *entry = begin; entry != end; ++entry)
+            fn(*entry, ranges[entry - begin].buffer);
+        return;
+    }
+    guint32 span_end = 0;
+    for (const DataEntry *entry = begin; entry != end; ++entry)
+        span_end = std::max(span_end, entry->offset + entry->size);
+    const guint32 span_begin = begin->offset;
+    std::vector<gchar> span(span_end - span_begin);
+    if (span.empty())
+        return;
+    read_data(&span[0], span_begin, span.size());
+    for (const DataEntry *entry = begin; entry != end; ++entry)
+        fn(*entry, &span[entry->offset - span_begin]);
+}
 
-    if (dictfile)
-        fseek(dictfile, idxitem_offset, SEEK_SET);
-    THROW_IF_ERROR(origin_data != nullptr);
-    if (dictfile) {
-        const size_t nitems = fread(origin_data, idxitem_size, 1, dictfile);
-        THROW_IF_ERROR(nitems == 1);
-    } else
-        dictdzfile->read(origin_data, idxitem_offset, idxitem_size);
-    gchar *p = origin_data;
+void DictBase::SearchData(const MultiMatcher &matcher, const DataEntry *begin, const DataEntry *end, std::vector<glong> &found)
+{
+    std::vector<bool> WordFind(matcher.size());
+    read_articles(begin, end, [this, &matcher, &found, &WordFind](const DataEntry &entry, const gchar *data) {
+        std::fill(WordFind.begin(), WordFind.end(), false);
+        size_t nfound = 0;
+        if (for_each_text_field(data, entry.size, [&](const gchar *text, guint32 len) {
+                return matcher.scan(text, len, WordFind, nfound);
+            }))
+            found.push_back(entry.idx);
+    });
+}
+
+// length of text field, it ends with '\0' or with the article
+static inline guint32 text_field_size(const gchar *p, const gchar *end)
+{
+    const gchar *nul = static_cast<const gchar *>(memchr(p, '\0', end - p));
+    return (nul ? nul : end) - p;
+}
+
+bool DictBase::for_each_text_field(const gchar *data, guint32 size, const std::function<bool(const gchar *, guint32)> &fn) const
+{
+    const gchar *p = data;
+    const gchar *const end = data + size;
     guint32 sec_size;
-    int j;
     if (!sametypesequence.empty()) {
         gint sametypesequence_len = sametypesequence.length();
         for (int i = 0; i < sametypesequence_len - 1; i++) {
+            if (p >= end)
+                return false;
             switch (sametypesequence[i]) {
             case 'm':
             case 't':
@@ -340,27 +569,25 @@ bool DictBase::SearchData(std::vector<std::string> &SearchWords, guint32 idxitem
             case 'g':
             case 'x':
             case 'k':
-                for (j = 0; j < nWord; j++)
-                    if (!WordFind[j] && strstr(p, SearchWords[j].c_str())) {
-                        WordFind[j] = true;
-                        ++nfound;
-                    }
-
-                if (nfound == nWord)
+                sec_size = text_field_size(p, end);
+                if (fn(p, sec_size))
                     return true;
-                sec_size = strlen(p) + 1;
-                p += sec_size;
+                p += sec_size + 1;
                 break;
             default:
                 if (g_ascii_isupper(sametypesequence[i])) {
+                    if (end - p < glong(sizeof(guint32)))
+                        return false;
                     sec_size = get_uint32(p);
                     sec_size += sizeof(guint32);
                 } else {
-                    sec_size = strlen(p) + 1;
+                    sec_size = text_field_size(p, end) + 1;
                 }
                 p += sec_size;
             }
         }
+        if (p >= end)
+            return false;
         switch (sametypesequence[sametypesequence_len - 1]) {
         case 'm':
         case 't':
@@ -369,19 +596,10 @@ bool DictBase::SearchData(std::vector<std::string> &SearchWords, guint32 idxitem
         case 'g':
         case 'x':
         case 'k':
-            sec_size = idxitem_size - (p - origin_data);
-            for (j = 0; j < nWord; j++)
-                if (!WordFind[j] && g_strstr_len(p, sec_size, SearchWords[j].c_str())) {
-                    WordFind[j] = true;
-                    ++nfound;
-                }
-
-            if (nfound == nWord)
-                return true;
-            break;
+            return fn(p, end - p);
         }
     } else {
-        while (guint32(p - origin_data) < idxitem_size) {
+        while (p < end) {
             switch (*p) {
             case 'm':
             case 't':
@@ -390,23 +608,19 @@ bool DictBase::SearchData(std::vector<std::string> &SearchWords, guint32 idxitem
             case 'g':
             case 'x':
             case 'k':
-                for (j = 0; j < nWord; j++)
-                    if (!WordFind[j] && strstr(p, SearchWords[j].c_str())) {
-                        WordFind[j] = true;
-                        ++nfound;
-                    }
-
-                if (nfound == nWord)
+                sec_size = text_field_size(p, end);
+                if (fn(p, sec_size))
                     return true;
-                sec_size = strlen(p) + 1;
-                p += sec_size;
+                p += sec_size + 1;
                 break;
             default:
                 if (g_ascii_isupper(*p)) {
+                    if (end - p < glong(sizeof(guint32)))
+                        return false;
                     sec_size = get_uint32(p);
                     sec_size += sizeof(guint32);
                 } else {
-                    sec_size = strlen(p) + 1;
+                    sec_size = text_field_size(p, end) + 1;
                 }
                 p += sec_size;
             }
@@ -421,21 +635,22 @@ class OffsetIndex : public IIndexFile
 {
 public:
     OffsetIndex()
-        : idxfile(nullptr)
+        : idxfd(-1)
+        , id(++last_id)
     {
     }
     ~OffsetIndex()
     {
-        if (idxfile)
-            fclose(idxfile);
+        if (idxfd >= 0)
+            close(idxfd);
     }
     bool load(const std::string &url, gulong wc, off_t fsize, bool verbose) override;
-    const gchar *get_key(glong idx) override;
-    void get_data(glong idx) override { get_key(idx); }
-    const gchar *get_key_and_data(glong idx) override
+    const gchar *get_key(glong idx) override
     {
-        return get_key(idx);
+        return get_key_and_data(idx, nullptr, nullptr);
     }
+    void get_data(glong idx, guint32 *offset, guint32 *size) override { get_key_and_data(idx, offset, size); }
+    const gchar *get_key_and_data(glong idx, guint32 *offset, guint32 *size) override;
     bool lookup(const char *str, std::set<glong> &idxs, glong &next_idx) override;
 
 private:
@@ -443,10 +658,15 @@ private:
     static const char *CACHE_MAGIC;
 
     std::vector<guint32> wordoffset;
-    FILE *idxfile;
+    // keys are used right from mapped index, pages are read with idxfd only if it can not be mapped
+    MapFile idxmap;
+    const gchar *idxdata = nullptr;
+    int idxfd;
     gulong wordcount;
+    // distinguish pages of different indexes in thread_page
+    const guint64 id;
+    static std::atomic<guint64> last_id;
 
-    gchar wordentry_buf[256 + sizeof(guint32) * 2]; // The length of "word_str" should be less than 256. See src/tools/DICTFILE_FORMAT.
     struct index_entry {
         glong idx;
         std::string keystr;
@@ -459,26 +679,36 @@ private:
     index_entry first, last, middle, real_last;
 
     struct page_entry {
-        gchar *keystr;
+        const gchar *keystr;
         guint32 off, size;
     };
-    std::vector<gchar> page_data;
     struct page_t {
         glong idx = -1;
         page_entry entries[ENTR_PER_PAGE];
 
         page_t() {}
-        void fill(gchar *data, gint nent, glong idx_);
-    } page;
-    gulong load_page(glong page_idx);
+        void fill(const gchar *data, gint nent, glong idx_);
+    };
+    // every thread reads pages into its own buffers, so lookups do not need locks
+    struct thread_page_t {
+        guint64 owner = 0;
+        page_t page;
+        std::vector<gchar> page_data;
+        gchar wordentry_buf[256 + sizeof(guint32) * 2]; // The length of "word_str" should be less than 256. See src/tools/DICTFILE_FORMAT.
+    };
+    static thread_local thread_page_t thread_page;
+    void read_at(gchar *buf, size_t size, guint32 offset);
+    const page_t &load_page(glong page_idx, gulong &nentr);
     const gchar *read_first_on_page_key(glong page_idx);
     const gchar *get_first_on_page_key(glong page_idx);
     bool load_cache(const std::string &url);
     bool save_cache(const std::string &url, bool verbose);
-    static std::list<std::string> get_cache_variant(const std::string &url);
+    static std::string get_cache_magic();
 };
 
 const char *OffsetIndex::CACHE_MAGIC = "StarDict's Cache, Version: 0.2";
+std::atomic<guint64> OffsetIndex::last_id(0);
+thread_local OffsetIndex::thread_page_t OffsetIndex::thread_page;
 #define CACHE_MAGIC_BYTES 0x51a4d1c1
 
 class WordListIndex : public IIndexFile
@@ -490,24 +720,24 @@ public:
     }
     ~WordListIndex() { g_free(idxdatabuf); }
     bool load(const std::string &url, gulong wc, off_t fsize, bool verbose) override;
-    const gchar *get_key(glong idx) override { return wordlist[idx]; }
-    void get_data(glong idx) override;
-    const gchar *get_key_and_data(glong idx) override
+    const gchar *get_key(glong idx) override { return wordlist.key(idx); }
+    void get_data(glong idx, guint32 *offset, guint32 *size) override;
+    const gchar *get_key_and_data(glong idx, guint32 *offset, guint32 *size) override
     {
-        get_data(idx);
+        get_data(idx, offset, size);
         return get_key(idx);
     }
     bool lookup(const char *str, std::set<glong> &idxs, glong &next_idx) override;
 
 private:
     gchar *idxdatabuf;
-    std::vector<gchar *> wordlist;
+    KeyOffsets wordlist;
 };
 
-void OffsetIndex::page_t::fill(gchar *data, gint nent, glong idx_)
+void OffsetIndex::page_t::fill(const gchar *data, gint nent, glong idx_)
 {
     idx = idx_;
-    gchar *p = data;
+    const gchar *p = data;
     glong len;
     for (gint i = 0; i < nent; ++i) {
         entries[i].keystr = p;
@@ -520,14 +750,28 @@ void OffsetIndex::page_t::fill(gchar *data, gint nent, glong idx_)
     }
 }
 
+void OffsetIndex::read_at(gchar *buf, size_t size, guint32 offset)
+{
+    while (size > 0) {
+        const ssize_t n = pread(idxfd, buf, size, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        THROW_IF_ERROR(n > 0);
+        buf += n;
+        offset += n;
+        size -= n;
+    }
+}
+
 inline const gchar *OffsetIndex::read_first_on_page_key(glong page_idx)
 {
-    fseek(idxfile, wordoffset[page_idx], SEEK_SET);
+    if (idxdata)
+        return idxdata + wordoffset[page_idx];
+    gchar *wordentry_buf = thread_page.wordentry_buf;
     guint32 page_size = wordoffset[page_idx + 1] - wordoffset[page_idx];
-    const size_t nitems = fread(wordentry_buf,
-                                std::min(sizeof(wordentry_buf), static_cast<size_t>(page_size)),
-                                1, idxfile);
-    THROW_IF_ERROR(nitems == 1);
+    read_at(wordentry_buf,
+            std::min(sizeof(thread_page.wordentry_buf), static_cast<size_t>(page_size)),
+            wordoffset[page_idx]);
     // TODO: check returned values, deal with word entry that strlen>255.
     return wordentry_buf;
 }
@@ -548,71 +792,30 @@ inline const gchar *OffsetIndex::get_first_on_page_key(glong page_idx)
 
 bool OffsetIndex::load_cache(const std::string &url)
 {
-    const std::list<std::string> vars = get_cache_variant(url);
-
-    for (const std::string &item : vars) {
-        struct ::stat idxstat, cachestat;
-        if (g_stat(url.c_str(), &idxstat) != 0 || g_stat(item.c_str(), &cachestat) != 0)
-            continue;
-        if (cachestat.st_mtime < idxstat.st_mtime)
-            continue;
-        MapFile mf;
-        if (!mf.open(item.c_str(), cachestat.st_size))
-            continue;
-        if (strncmp(mf.begin(), CACHE_MAGIC, strlen(CACHE_MAGIC)) != 0)
-            continue;
-        guint32 tmp;
-        memcpy(&tmp, mf.begin() + strlen(CACHE_MAGIC), sizeof(tmp));
-        if (tmp != CACHE_MAGIC_BYTES)
-            continue;
-        memcpy(&wordoffset[0], mf.begin() + strlen(CACHE_MAGIC) + sizeof(guint32), wordoffset.size() * sizeof(wordoffset[0]));
-        return true;
-    }
-
-    return false;
+    CacheFile cache;
+    if (!cache.load(url, ".oft", get_cache_magic()))
+        return false;
+    if (cache.size() < wordoffset.size() * sizeof(wordoffset[0]))
+        return false;
+    memcpy(&wordoffset[0], cache.data(), wordoffset.size() * sizeof(wordoffset[0]));
+    return true;
 }
 
-std::list<std::string> OffsetIndex::get_cache_variant(const std::string &url)
+std::string OffsetIndex::get_cache_magic()
 {
-    std::list<std::string> res = { url + ".oft" };
-    if (!g_file_test(g_get_user_cache_dir(), G_FILE_TEST_EXISTS) && g_mkdir(g_get_user_cache_dir(), 0700) == -1)
-        return res;
-
-    const std::string cache_dir = std::string(g_get_user_cache_dir()) + G_DIR_SEPARATOR_S + "sdcv";
-
-    if (!g_file_test(cache_dir.c_str(), G_FILE_TEST_EXISTS)) {
-        if (g_mkdir(cache_dir.c_str(), 0700) == -1)
-            return res;
-    } else if (!g_file_test(cache_dir.c_str(), G_FILE_TEST_IS_DIR))
-        return res;
-
-    gchar *base = g_path_get_basename(url.c_str());
-    res.push_back(cache_dir + G_DIR_SEPARATOR_S + base + ".oft");
-    g_free(base);
-    return res;
+    const guint32 magic = CACHE_MAGIC_BYTES;
+    return std::string(CACHE_MAGIC) + std::string(reinterpret_cast<const char *>(&magic), sizeof(magic));
 }
 
 bool OffsetIndex::save_cache(const std::string &url, bool verbose)
 {
-    const std::list<std::string> vars = get_cache_variant(url);
-    for (const std::string &item : vars) {
-        FILE *out = fopen(item.c_str(), "wb");
-        guint32 magic = CACHE_MAGIC_BYTES;
-        if (!out)
-            continue;
-        if (fwrite(CACHE_MAGIC, 1, strlen(CACHE_MAGIC), out) != strlen(CACHE_MAGIC))
-            continue;
-        if (fwrite(&magic, 1, sizeof(magic), out) != sizeof(magic))
-            continue;
-        if (fwrite(&wordoffset[0], sizeof(wordoffset[0]), wordoffset.size(), out) != wordoffset.size())
-            continue;
-        fclose(out);
-        if (verbose) {
-            printf("save to cache %s\n", url.c_str());
-        }
-        return true;
+    const bool saved = CacheFile::save(url, ".oft", get_cache_magic(), [this](FILE *out) {
+        return fwrite(&wordoffset[0], sizeof(wordoffset[0]), wordoffset.size(), out) == wordoffset.size();
+    });
+    if (saved && verbose) {
+        printf("save to cache %s\n", url.c_str());
     }
-    return false;
+    return saved;
 }
 
 bool OffsetIndex::load(const std::string &url, gulong wc, off_t fsize, bool verbose)
@@ -620,11 +823,22 @@ bool OffsetIndex::load(const std::string &url, gulong wc, off_t fsize, bool verb
     wordcount = wc;
     gulong npages = (wc - 1) / ENTR_PER_PAGE + 2;
     wordoffset.resize(npages);
+    if (idxmap.open(url.c_str(), fsize)) {
+        idxdata = idxmap.begin();
+        idxmap.advise_random_access();
+    } else if ((idxfd = open(url.c_str(), O_RDONLY)) < 0) {
+        wordoffset.resize(0);
+        return false;
+    }
+
     if (!load_cache(url)) { // map file will close after finish of block
         MapFile map_file;
-        if (!map_file.open(url.c_str(), fsize))
-            return false;
-        const gchar *idxdatabuffer = map_file.begin();
+        const gchar *idxdatabuffer = idxdata;
+        if (!idxdatabuffer) {
+            if (!map_file.open(url.c_str(), fsize))
+                return false;
+            idxdatabuffer = map_file.begin();
+        }
 
         const gchar *p1 = idxdatabuffer;
         gulong index_size;
@@ -642,11 +856,6 @@ bool OffsetIndex::load(const std::string &url, gulong wc, off_t fsize, bool verb
             fprintf(stderr, "cache update failed\n");
     }
 
-    if (!(idxfile = fopen(url.c_str(), "rb"))) {
-        wordoffset.resize(0);
-        return false;
-    }
-
     first.assign(0, read_first_on_page_key(0));
     last.assign(wordoffset.size() - 2, read_first_on_page_key(wordoffset.size() - 2));
     middle.assign((wordoffset.size() - 2) / 2, read_first_on_page_key((wordoffset.size() - 2) / 2));
@@ -655,31 +864,37 @@ bool OffsetIndex::load(const std::string &url, gulong wc, off_t fsize, bool verb
     return true;
 }
 
-inline gulong OffsetIndex::load_page(glong page_idx)
+inline const OffsetIndex::page_t &OffsetIndex::load_page(glong page_idx, gulong &nentr)
 {
-    gulong nentr = ENTR_PER_PAGE;
+    nentr = ENTR_PER_PAGE;
     if (page_idx == glong(wordoffset.size() - 2))
         if ((nentr = (wordcount % ENTR_PER_PAGE)) == 0)
             nentr = ENTR_PER_PAGE;
 
-    if (page_idx != page.idx) {
-        page_data.resize(wordoffset[page_idx + 1] - wordoffset[page_idx]);
-        fseek(idxfile, wordoffset[page_idx], SEEK_SET);
-        const size_t nitems = fread(&page_data[0], 1, page_data.size(), idxfile);
-        THROW_IF_ERROR(nitems == page_data.size());
-
-        page.fill(&page_data[0], nentr, page_idx);
+    thread_page_t &tp = thread_page;
+    if (tp.owner != id || page_idx != tp.page.idx) {
+        if (idxdata) {
+            tp.page.fill(idxdata + wordoffset[page_idx], nentr, page_idx);
+        } else {
+            tp.page_data.resize(wordoffset[page_idx + 1] - wordoffset[page_idx]);
+            read_at(&tp.page_data[0], tp.page_data.size(), wordoffset[page_idx]);
+            tp.page.fill(&tp.page_data[0], nentr, page_idx);
+        }
+        tp.owner = id;
     }
 
-    return nentr;
+    return tp.page;
 }
 
-const gchar *OffsetIndex::get_key(glong idx)
+const gchar *OffsetIndex::get_key_and_data(glong idx, guint32 *offset, guint32 *size)
 {
-    load_page(idx / ENTR_PER_PAGE);
+    gulong nentr;
+    const page_t &page = load_page(idx / ENTR_PER_PAGE, nentr);
     glong idx_in_page = idx % ENTR_PER_PAGE;
-    wordentry_offset = page.entries[idx_in_page].off;
-    wordentry_size = page.entries[idx_in_page].size;
+    if (offset)
+        *offset = page.entries[idx_in_page].off;
+    if (size)
+        *size = page.entries[idx_in_page].size;
 
     return page.entries[idx_in_page].keystr;
 }
@@ -724,7 +939,8 @@ bool OffsetIndex::lookup(const char *str, std::set<glong> &idxs, glong &next_idx
         // should contain it. Binary search here is slightly overkill (we're
         // searching at most ENTR_PER_PAGE = 32 elements) but this way next_idx
         // is treated the same as other Lookup methods.
-        gulong netr = load_page(iPage);
+        gulong netr;
+        const page_t &page = load_page(iPage, netr);
         iFrom = 0;
         iTo = netr - 1;
         while (iFrom <= iTo) {
@@ -774,24 +990,15 @@ bool WordListIndex::load(const std::string &url, gulong wc, off_t fsize, bool)
     if (static_cast<off_t>(len) != fsize)
         return false;
 
-    wordlist.resize(wc + 1);
-    gchar *p1 = idxdatabuf;
-    guint32 i;
-    for (i = 0; i < wc; i++) {
-        wordlist[i] = p1;
-        p1 += strlen(p1) + 1 + 2 * sizeof(guint32);
-    }
-    wordlist[wc] = p1;
-
-    return true;
+    return wordlist.load(url, idxdatabuf, fsize, wc, 2 * sizeof(guint32));
 }
 
-void WordListIndex::get_data(glong idx)
+void WordListIndex::get_data(glong idx, guint32 *offset, guint32 *size)
 {
-    gchar *p1 = wordlist[idx] + strlen(wordlist[idx]) + sizeof(gchar);
-    wordentry_offset = g_ntohl(get_uint32(p1));
+    const gchar *p1 = wordlist.data(idx);
+    *offset = g_ntohl(get_uint32(p1));
     p1 += sizeof(guint32);
-    wordentry_size = g_ntohl(get_uint32(p1));
+    *size = g_ntohl(get_uint32(p1));
 }
 
 bool WordListIndex::lookup(const char *str, std::set<glong> &idxs, glong &next_idx)
@@ -844,20 +1051,10 @@ bool SynFile::load(const std::string &url, gulong wc)
         if (!synfile.open(url.c_str(), stat_buf.st_size))
             return false;
 
-        synlist.resize(wc + 1);
-        gchar *p1 = synfile.begin();
-
-        for (unsigned long i = 0; i < wc; i++) {
-            // each entry in a syn-file is:
-            // - 0-terminated string
-            // 4-byte index into .dict file in network byte order
-
-            synlist[i] = p1;
-            p1 += strlen(p1) + 1 + 4;
-        }
-        synlist[wc] = p1;
-
-        return true;
+        // each entry in a syn-file is:
+        // - 0-terminated string
+        // 4-byte index into .dict file in network byte order
+        return synlist.load(url, synfile.begin(), stat_buf.st_size, wc, sizeof(guint32));
     } else {
         return false;
     }
@@ -896,53 +1093,258 @@ bool SynFile::lookup(const char *str, std::set<glong> &idxs, glong &next_idx)
             // In order to return all idxs that match the search string, walk
             // linearly behind and ahead of the found index.
             glong iHeadIndex = iThisIndex - 1; // do not include iThisIndex
-            while (iHeadIndex >= 0 && stardict_strcmp(str, get_key(iHeadIndex)) == 0) {
-                const gchar *key = get_key(iHeadIndex--);
-                idxs.insert(g_ntohl(get_uint32(key + strlen(key) + 1)));
-            }
+            while (iHeadIndex >= 0 && stardict_strcmp(str, get_key(iHeadIndex)) == 0)
+                idxs.insert(get_word_index(iHeadIndex--));
             do {
                 // no need to double-check iThisIndex -- we know it's a match already
-                const gchar *key = get_key(iThisIndex++);
-                idxs.insert(g_ntohl(get_uint32(key + strlen(key) + 1)));
+                idxs.insert(get_word_index(iThisIndex++));
             } while (iThisIndex <= iLast && stardict_strcmp(str, get_key(iThisIndex)) == 0);
         }
     }
     return bFound;
 }
 
+void SynFile::lookup(const char *const *strs, size_t nstrs, std::vector<std::set<glong>> &found)
+{
+    const glong nkeys = synlist.size() > 0 ? synlist.size() - 1 : 0;
+    merge_lookup(nkeys, [this](glong j) { return get_key(j); }, strs, nstrs, [this, &found](size_t i, glong j) {
+        found[i].insert(get_word_index(j));
+    });
+}
+
+void SynFile::lookup_prefix(const char *prefix, size_t max_words, std::vector<std::pair<std::string, glong>> &words)
+{
+    const glong nkeys = synlist.size() > 0 ? synlist.size() - 1 : 0;
+    prefix_lookup(nkeys, [this](glong j) { return get_key(j); }, prefix, max_words, [this, &words](glong j, const gchar *key) {
+        words.emplace_back(key, get_word_index(j));
+    });
+}
+
+void Dict::Lookup(const char *const *strs, size_t nstrs, std::vector<std::set<glong>> &found)
+{
+    if (!open())
+        return;
+    syn_file->lookup(strs, nstrs, found);
+    merge_lookup(wordcount, [this](glong j) { return idx_file->get_key(j); }, strs, nstrs,
+                 [&found](size_t i, glong j) { found[i].insert(j); });
+}
+
 bool Dict::Lookup(const char *str, std::set<glong> &idxs, glong &next_idx)
 {
+    if (!open())
+        return false;
     bool found = false;
     found |= syn_file->lookup(str, idxs, next_idx);
     found |= idx_file->lookup(str, idxs, next_idx);
     return found;
 }
 
-bool Dict::load(const std::string &ifofilename, bool verbose)
+bool Dict::Lookup(const char *str, std::set<glong> &idxs)
+{
+    if (!open())
+        return false;
+    // hash gives some entry for any string, only equal words are taken from it
+    auto equal = [str](const gchar *key) { return strcmp(key, str) == 0; };
+    if (use_hash_index && load_hash_index())
+        return lookup_ranges(hash_index->lookup(str), equal, idxs);
+    if (use_trie_index && load_trie_index())
+        return lookup_ranges(trie_index->lookup(str), equal, idxs);
+    glong unused_next_idx;
+    return Lookup(str, idxs, unused_next_idx);
+}
+
+bool Dict::lookup_ranges(const WordRanges &ranges, const std::function<bool(const gchar *)> &match, std::set<glong> &idxs)
+{
+    bool found = false;
+    for (glong i = ranges.syn_from; i < glong(ranges.syn_from + ranges.syn_count); ++i)
+        if (match(syn_file->get_key(i))) {
+            idxs.insert(syn_file->get_word_index(i));
+            found = true;
+        }
+    for (glong i = ranges.idx_from; i < glong(ranges.idx_from + ranges.idx_count); ++i)
+        if (match(get_key(i))) {
+            idxs.insert(i);
+            found = true;
+        }
+    return found;
+}
+
+WordRanges Dict::ascii_case_ranges(const char *str)
+{
+    // hash gives some ranges for any string, they are checked by caller
+    if (use_hash_index && load_hash_index())
+        return hash_index->lookup(str);
+    if (use_trie_index && load_trie_index())
+        return trie_index->lookup(str);
+    WordRanges ranges;
+    ascii_case_range(wordcount, [this](glong j) { return get_key(j); }, str, &ranges.idx_from, &ranges.idx_count);
+    ascii_case_range(syn_file->nwords(), [this](glong j) { return syn_file->get_key(j); }, str,
+                     &ranges.syn_from, &ranges.syn_count);
+    return ranges;
+}
+
+bool Dict::LookupCaseForms(const char *str, std::initializer_list<CaseForm> forms, std::set<glong> &idxs)
+{
+    if (!open())
+        return false;
+    if (bIsPureEnglish(str)) {
+        // forms are compared with words without making them
+        const WordRanges ranges = ascii_case_ranges(str);
+        for (CaseForm form : forms)
+            if (lookup_ranges(ranges, [str, form](const gchar *key) { return is_ascii_case_form(key, str, form); }, idxs))
+                return true;
+        return false;
+    }
+
+    std::vector<std::string> strs;
+    for (CaseForm form : forms)
+        strs.push_back(case_form(str, form));
+    if (!load_case_index()) {
+        for (const std::string &form : strs)
+            if (Lookup(form.c_str(), idxs))
+                return true;
+        return false;
+    }
+    // forms usually have the same folded form, it is looked for once
+    std::vector<std::string> folded;
+    std::vector<guint32> places;
+    for (const std::string &form : strs) {
+        const std::string fold = FoldIndex::fold_case(form.c_str());
+        if (std::find(folded.begin(), folded.end(), fold) == folded.end()) {
+            folded.push_back(fold);
+            case_index->lookup(fold.c_str(), places);
+        }
+    }
+    for (const std::string &form : strs) {
+        bool found = false;
+        for (guint32 place : places)
+            if (place < wordcount) {
+                if (form == get_key(place)) {
+                    idxs.insert(place);
+                    found = true;
+                }
+            } else if (form == syn_file->get_key(place - wordcount)) {
+                idxs.insert(syn_file->get_word_index(place - wordcount));
+                found = true;
+            }
+        if (found)
+            return true;
+    }
+    return false;
+}
+
+bool Dict::LookupWithoutMarks(const char *str, std::set<glong> &idxs)
 {
-    off_t idxfilesize;
-    if (!load_ifofile(ifofilename, idxfilesize))
+    if (!open() || !load_marks_index())
         return false;
+    std::vector<guint32> places;
+    marks_index->lookup(FoldIndex::fold_marks(str).c_str(), places);
+    for (guint32 place : places)
+        idxs.insert(place < wordcount ? place : syn_file->get_word_index(place - wordcount));
+    return !places.empty();
+}
 
-    std::string fullfilename(ifofilename);
+void Dict::load_fold_index(const FoldIndex::Fold &fold, const std::string &suffix, std::unique_ptr<FoldIndex> &index)
+{
+    std::list<std::string> sources;
+    if (!syn_file_name.empty())
+        sources.push_back(syn_file_name);
+    std::unique_ptr<FoldIndex> loaded(new FoldIndex);
+    if (loaded->load(idx_file_name, suffix, sources, fold, wordcount, [this](glong i) { return get_key(i); },
+                     syn_file->nwords(), [this](glong i) { return syn_file->get_key(i); }))
+        index = std::move(loaded);
+}
+
+bool Dict::load_case_index()
+{
+    std::call_once(case_index_once, [this]() { load_fold_index(FoldIndex::fold_case, ".cfi", case_index); });
+    return case_index != nullptr;
+}
+
+bool Dict::load_marks_index()
+{
+    std::call_once(marks_index_once, [this]() { load_fold_index(FoldIndex::fold_marks, ".mfi", marks_index); });
+    return marks_index != nullptr;
+}
+
+bool Dict::load_hash_index()
+{
+    std::call_once(hash_index_once, [this]() {
+        std::list<std::string> sources;
+        if (!syn_file_name.empty())
+            sources.push_back(syn_file_name);
+        std::unique_ptr<HashIndex> index(new HashIndex);
+        if (index->load(idx_file_name, sources, wordcount, [this](glong i) { return get_key(i); },
+                        syn_file->nwords(), [this](glong i) { return syn_file->get_key(i); }))
+            hash_index = std::move(index);
+    });
+    return hash_index != nullptr;
+}
+
+bool Dict::load_trie_index()
+{
+    std::call_once(trie_index_once, [this]() {
+        std::list<std::string> sources;
+        if (!syn_file_name.empty())
+            sources.push_back(syn_file_name);
+        std::unique_ptr<TrieIndex> index(new TrieIndex);
+        if (index->load(idx_file_name, sources, wordcount, [this](glong i) { return get_key(i); },
+                        syn_file->nwords(), [this](glong i) { return syn_file->get_key(i); }))
+            trie_index = std::move(index);
+    });
+    return trie_index != nullptr;
+}
+
+bool Dict::load(const std::string &ifofilename, bool verbose, bool lazy)
+{
+    DictInfo dict_info;
+    if (!dict_info.load_from_ifo_file(ifofilename, false))
+        return false;
+    return load(dict_info, verbose, lazy);
+}
+
+bool Dict::load(const DictInfo &dict_info, bool verbose, bool lazy)
+{
+    if (dict_info.wordcount == 0)
+        return false;
+
+    ifo_file_name = dict_info.ifo_file_name;
+    wordcount = dict_info.wordcount;
+    syn_wordcount = dict_info.syn_wordcount;
+    bookname = dict_info.bookname;
+
+    idxfilesize = dict_info.index_file_size;
+
+    sametypesequence = dict_info.sametypesequence;
+
+    this->verbose = verbose;
+
+    return lazy || open();
+}
+
+bool Dict::open_files()
+{
+    std::string fullfilename(ifo_file_name);
     fullfilename.replace(fullfilename.length() - sizeof("ifo") + 1, sizeof("ifo") - 1, "dict.dz");
 
     if (g_file_test(fullfilename.c_str(), G_FILE_TEST_EXISTS)) {
         dictdzfile.reset(new DictData);
+        dictdzfile->set_thread_pool(thread_pool);
         if (!dictdzfile->open(fullfilename, 0)) {
             // g_print("open file %s failed!\n",fullfilename);
             return false;
         }
     } else {
         fullfilename.erase(fullfilename.length() - sizeof(".dz") + 1, sizeof(".dz") - 1);
-        dictfile = fopen(fullfilename.c_str(), "rb");
-        if (!dictfile) {
+        dictfd = ::open(fullfilename.c_str(), O_RDONLY);
+        if (dictfd < 0) {
             // g_print("open file %s failed!\n",fullfilename);
             return false;
         }
     }
+    dict_file_name = fullfilename;
 
-    fullfilename = ifofilename;
+    fullfilename = ifo_file_name;
     fullfilename.replace(fullfilename.length() - sizeof("ifo") + 1, sizeof("ifo") - 1, "idx.gz");
 
     if (g_file_test(fullfilename.c_str(), G_FILE_TEST_EXISTS)) {
@@ -954,49 +1356,148 @@ bool Dict::load(const std::string &ifofilename, bool verbose)
 
     if (!idx_file->load(fullfilename, wordcount, idxfilesize, verbose))
         return false;
+    idx_file_name = fullfilename;
 
-    fullfilename = ifofilename;
+    fullfilename = ifo_file_name;
     fullfilename.replace(fullfilename.length() - sizeof("ifo") + 1, sizeof("ifo") - 1, "syn");
     syn_file.reset(new SynFile);
-    syn_file->load(fullfilename, syn_wordcount);
+    if (syn_file->load(fullfilename, syn_wordcount))
+        syn_file_name = fullfilename;
 
     // g_print("bookname: %s , wordcount %lu\n", bookname.c_str(), narticles());
     return true;
 }
 
-bool Dict::load_ifofile(const std::string &ifofilename, off_t &idxfilesize)
+bool Dict::LookupFuzzyCandidates(const gunichar *str, glong len, int max_distance, std::vector<glong> &idxs)
 {
-    DictInfo dict_info;
-    if (!dict_info.load_from_ifo_file(ifofilename, false))
+    if (!open())
         return false;
-    if (dict_info.wordcount == 0)
-        return false;
-
-    ifo_file_name = dict_info.ifo_file_name;
-    wordcount = dict_info.wordcount;
-    syn_wordcount = dict_info.syn_wordcount;
-    bookname = dict_info.bookname;
-
-    idxfilesize = dict_info.index_file_size;
+    std::call_once(fuzzy_index_once, [this]() {
+        std::unique_ptr<FuzzyIndex> index(new FuzzyIndex);
+        if (index->load(idx_file_name, wordcount, [this](glong i) { return get_key(i); }))
+            fuzzy_index = std::move(index);
+    });
+    return fuzzy_index && fuzzy_index->lookup(str, len, max_distance, idxs);
+}
 
-    sametypesequence = dict_info.sametypesequence;
+void Dict::get_data_entries(std::vector<DataEntry> &entries)
+{
+    if (!open()) {
+        entries.clear();
+        return;
+    }
+    for (DataEntry &entry : entries)
+        idx_file->get_data(entry.idx, &entry.offset, &entry.size);
+    std::sort(entries.begin(), entries.end(), [](const DataEntry &lh, const DataEntry &rh) {
+        return lh.offset < rh.offset || (lh.offset == rh.offset && lh.idx < rh.idx);
+    });
+}
 
-    return true;
+bool Dict::LookupDataCandidates(const std::vector<std::string> &words, std::vector<glong> &idxs)
+{
+    if (!open())
+        return false;
+    std::call_once(data_index_once, [this]() {
+        std::unique_ptr<DataIndex> index(new DataIndex);
+        if (index->load(dict_file_name, { idx_file_name }, wordcount, [this](DataIndex::Builder &builder) {
+                std::vector<DataEntry> entries(wordcount);
+                for (gulong i = 0; i < wordcount; ++i)
+                    entries[i].idx = i;
+                get_data_entries(entries);
+                for (size_t from = 0; from < entries.size();) {
+                    const size_t to = next_data_chunk(entries, from);
+                    read_articles(entries.data() + from, entries.data() + to, [this, &builder](const DataEntry &entry, const gchar *data) {
+                        for_each_text_field(data, entry.size, [&builder, &entry](const gchar *text, guint32 len) {
+                            builder.add(entry.idx, text, len);
+                            return false;
+                        });
+                    });
+                    from = to;
+                }
+            }))
+            data_index = std::move(index);
+    });
+    return data_index && data_index->lookup(words, idxs);
 }
 
-bool Dict::LookupWithRule(GPatternSpec *pspec, glong *aIndex, int iBuffLen)
+bool Dict::LookupWithRule(const gchar *pattern, GPatternSpec *pspec, glong *aIndex, int iBuffLen)
 {
     int iIndexCount = 0;
-
-    for (guint32 i = 0; i < narticles() && iIndexCount < (iBuffLen - 1); i++)
+    if (!open()) {
+        aIndex[0] = -1;
+        return false;
+    }
+    const gulong nwords = wordcount;
+    auto match = [this, pspec, aIndex, &iIndexCount](glong i) {
         if (g_pattern_spec_match_string(pspec, get_key(i)))
             aIndex[iIndexCount++] = i;
+    };
+
+    // only words which start with the literal prefix of pattern or end
+    // with its literal suffix are checked, in the same order as all words
+    const size_t prefix_len = strcspn(pattern, "*?");
+    const char *suffix = pattern + strlen(pattern);
+    while (suffix > pattern && suffix[-1] != '*' && suffix[-1] != '?')
+        --suffix;
+    if (prefix_len > 0) {
+        glong i = index_prefix_start(pattern, prefix_len);
+        for (; i < glong(nwords) && iIndexCount < (iBuffLen - 1) && g_ascii_strncasecmp(get_key(i), pattern, prefix_len) == 0; ++i)
+            match(i);
+    } else if (*suffix && load_suffix_index()) {
+        std::vector<glong> idxs;
+        suffix_index->lookup(suffix, [this](glong j) { return get_key(j); }, idxs);
+        for (size_t i = 0; i < idxs.size() && iIndexCount < (iBuffLen - 1); ++i)
+            match(idxs[i]);
+    } else {
+        for (guint32 i = 0; i < nwords && iIndexCount < (iBuffLen - 1); i++)
+            match(i);
+    }
 
     aIndex[iIndexCount] = -1; // -1 is the end.
 
     return iIndexCount > 0;
 }
 
+glong Dict::index_prefix_start(const char *prefix, size_t len)
+{
+    if (!use_trie_index || !load_trie_index())
+        return prefix_range_start(wordcount, [this](glong j) { return get_key(j); }, prefix, len);
+    const WordRanges ranges = trie_index->lookup_prefix(std::string(prefix, len).c_str());
+    return ranges.idx_count > 0 ? glong(ranges.idx_from) : glong(wordcount);
+}
+
+bool Dict::load_suffix_index()
+{
+    std::call_once(suffix_index_once, [this]() {
+        std::unique_ptr<SuffixIndex> index(new SuffixIndex);
+        if (index->load(idx_file_name, wordcount, [this](glong i) { return get_key(i); }))
+            suffix_index = std::move(index);
+    });
+    return suffix_index != nullptr;
+}
+
+void Dict::get_same_words(glong index, std::set<glong> &idxs)
+{
+    // key is valid only until the next call of get_key
+    const std::string word(get_key(index));
+    glong from = index, to = index + 1;
+    while (from > 0 && word == get_key(from - 1))
+        --from;
+    while (to < glong(narticles()) && word == get_key(to))
+        ++to;
+    for (glong i = from; i < to; ++i)
+        idxs.insert(i);
+}
+
+void Dict::LookupWithPrefix(const char *prefix, size_t max_words, std::vector<std::pair<std::string, glong>> &words)
+{
+    if (!open())
+        return;
+    prefix_lookup(index_prefix_start(prefix, strlen(prefix)), wordcount, [this](glong j) { return idx_file->get_key(j); },
+                  prefix, max_words, [&words](glong j, const gchar *key) { words.emplace_back(key, j); });
+    syn_file->lookup_prefix(prefix, max_words, words);
+}
+
 Libs::~Libs()
 {
     for (Dict *p : oLib)
@@ -1006,59 +1507,76 @@ Libs::~Libs()
 void Libs::load_dict(const std::string &url)
 {
     Dict *lib = new Dict;
-    if (lib->load(url, verbose_))
+    if (lib->load(url, verbose_, lazy_)) {
+        lib->set_thread_pool(pool_.get());
+        lib->set_hash_index(hash_index_);
+        lib->set_trie_index(trie_index_);
         oLib.push_back(lib);
-    else
+    } else {
         delete lib;
+    }
 }
 
 void Libs::load(const std::list<std::string> &dicts_dirs,
                 const std::list<std::string> &order_list,
                 const std::list<std::string> &disable_list)
 {
-    for_each_file(dicts_dirs, ".ifo", order_list, disable_list,
-                  [this](const std::string &url, bool disable) -> void {
-                      if (!disable)
-                          load_dict(url);
-                  });
+    std::vector<DictInfo> dict_infos;
+    load_dict_infos(dicts_dirs, dict_infos);
+    load(dict_infos, order_list, disable_list);
 }
 
-bool Libs::LookupSimilarWord(const gchar *sWord, std::set<glong> &iWordIndices, int iLib)
+void Libs::load(const std::vector<DictInfo> &dict_infos,
+                const std::list<std::string> &order_list,
+                const std::list<std::string> &disable_list)
 {
-    bool bFound = false;
-    gchar *casestr;
-
-    if (!bFound) {
-        // to lower case.
-        casestr = g_utf8_strdown(sWord, -1);
-        if (strcmp(casestr, sWord)) {
-            if (oLib[iLib]->Lookup(casestr, iWordIndices))
-                bFound = true;
-        }
-        g_free(casestr);
-        // to upper case.
-        if (!bFound) {
-            casestr = g_utf8_strup(sWord, -1);
-            if (strcmp(casestr, sWord)) {
-                if (oLib[iLib]->Lookup(casestr, iWordIndices))
-                    bFound = true;
-            }
-            g_free(casestr);
-        }
-        // Upper the first character and lower others.
-        if (!bFound) {
-            const gchar *nextchar = g_utf8_next_char(sWord);
-            gchar *firstchar = g_utf8_strup(sWord, nextchar - sWord);
-            nextchar = g_utf8_strdown(nextchar, -1);
-            casestr = g_strdup_printf("%s%s", firstchar, nextchar);
-            g_free(firstchar);
-            if (strcmp(casestr, sWord)) {
-                if (oLib[iLib]->Lookup(casestr, iWordIndices))
-                    bFound = true;
-            }
-            g_free(casestr);
-        }
+    auto is_disabled = [&disable_list](const std::string &url) {
+        return std::find(disable_list.begin(), disable_list.end(), url) != disable_list.end();
+    };
+    // the same order as for_each_file gives
+    std::vector<const DictInfo *> infos;
+    for (const std::string &url : order_list) {
+        auto it = std::find_if(dict_infos.begin(), dict_infos.end(), [&url](const DictInfo &info) {
+            return info.ifo_file_name == url;
+        });
+        if (it != dict_infos.end() && !is_disabled(url))
+            infos.push_back(&*it);
     }
+    for (const DictInfo &info : dict_infos)
+        if (std::find(order_list.begin(), order_list.end(), info.ifo_file_name) == order_list.end()
+            && !is_disabled(info.ifo_file_name))
+            infos.push_back(&info);
+
+    // files of dictionaries are opened at once, but the order is kept
+    std::vector<std::unique_ptr<Dict>> dicts(infos.size());
+    pool_->parallel_for(infos.size(), [this, &infos, &dicts](size_t i) {
+        std::unique_ptr<Dict> lib(new Dict);
+        if (lib->load(*infos[i], verbose_, lazy_))
+            dicts[i] = std::move(lib);
+    });
+    for (std::unique_ptr<Dict> &lib : dicts)
+        if (lib) {
+            lib->set_thread_pool(pool_.get());
+            lib->set_hash_index(hash_index_);
+            lib->set_trie_index(trie_index_);
+            oLib.push_back(lib.release());
+        }
+}
+
+void Libs::load_dict_infos(const std::list<std::string> &dicts_dirs, std::vector<DictInfo> &dict_infos)
+{
+    DictCatalog(dicts_dirs).load(pool_.get(), dict_infos);
+}
+
+bool Libs::LookupSimilarWord(const gchar *sWord, std::set<glong> &iWordIndices, int iLib)
+{
+    bool bFound = oLib[iLib]->LookupCaseForms(sWord, { Dict::cfLOWER, Dict::cfUPPER, Dict::cfTITLE }, iWordIndices);
+    // word without suffix, in lower case too if the word has upper case letters
+    auto lookup_stem = [this, iLib, &iWordIndices](const gchar *stem, bool lower) {
+        if (lower)
+            return oLib[iLib]->LookupCaseForms(stem, { Dict::cfSAME, Dict::cfLOWER }, iWordIndices);
+        return oLib[iLib]->LookupCaseForms(stem, { Dict::cfSAME }, iWordIndices);
+    };
 
     if (bIsPureEnglish(sWord)) {
         // If not Found , try other status of sWord.
@@ -1073,16 +1591,8 @@ bool Libs::LookupSimilarWord(const gchar *sWord, std::set<glong> &iWordIndices,
             if (isupcase || sWord[iWordLen - 1] == 's' || !strncmp(&sWord[iWordLen - 2], "ed", 2)) {
                 strcpy(sNewWord, sWord);
                 sNewWord[iWordLen - 1] = '\0'; // cut "s" or "d"
-                if (oLib[iLib]->Lookup(sNewWord, iWordIndices))
+                if (lookup_stem(sNewWord, isupcase || g_ascii_isupper(sWord[0])))
                     bFound = true;
-                else if (isupcase || g_ascii_isupper(sWord[0])) {
-                    casestr = g_ascii_strdown(sNewWord, -1);
-                    if (strcmp(casestr, sNewWord)) {
-                        if (oLib[iLib]->Lookup(casestr, iWordIndices))
-                            bFound = true;
-                    }
-                    g_free(casestr);
-                }
             }
         }
 
@@ -1096,32 +1606,14 @@ bool Libs::LookupSimilarWord(const gchar *sWord, std::set<glong> &iWordIndices,
                     && !bIsVowel(sNewWord[iWordLen - 4]) && bIsVowel(sNewWord[iWordLen - 5])) { // doubled
 
                     sNewWord[iWordLen - 3] = '\0';
-                    if (oLib[iLib]->Lookup(sNewWord, iWordIndices))
+                    if (lookup_stem(sNewWord, isupcase || g_ascii_isupper(sWord[0])))
                         bFound = true;
-                    else {
-                        if (isupcase || g_ascii_isupper(sWord[0])) {
-                            casestr = g_ascii_strdown(sNewWord, -1);
-                            if (strcmp(casestr, sNewWord)) {
-                                if (oLib[iLib]->Lookup(casestr, iWordIndices))
-                                    bFound = true;
-                            }
-                            g_free(casestr);
-                        }
-                        if (!bFound)
-                            sNewWord[iWordLen - 3] = sNewWord[iWordLen - 4]; // restore
-                    }
+                    else
+                        sNewWord[iWordLen - 3] = sNewWord[iWordLen - 4]; // restore
                 }
                 if (!bFound) {
-                    if (oLib[iLib]->Lookup(sNewWord, iWordIndices))
+                    if (lookup_stem(sNewWord, isupcase || g_ascii_isupper(sWord[0])))
                         bFound = true;
-                    else if (isupcase || g_ascii_isupper(sWord[0])) {
-                        casestr = g_ascii_strdown(sNewWord, -1);
-                        if (strcmp(casestr, sNewWord)) {
-                            if (oLib[iLib]->Lookup(casestr, iWordIndices))
-                                bFound = true;
-                        }
-                        g_free(casestr);
-                    }
                 }
             }
         }
@@ -1135,48 +1627,22 @@ bool Libs::LookupSimilarWord(const gchar *sWord, std::set<glong> &iWordIndices,
                 if (iWordLen > 6 && (sNewWord[iWordLen - 4] == sNewWord[iWordLen - 5])
                     && !bIsVowel(sNewWord[iWordLen - 5]) && bIsVowel(sNewWord[iWordLen - 6])) { // doubled
                     sNewWord[iWordLen - 4] = '\0';
-                    if (oLib[iLib]->Lookup(sNewWord, iWordIndices))
+                    if (lookup_stem(sNewWord, isupcase || g_ascii_isupper(sWord[0])))
                         bFound = true;
-                    else {
-                        if (isupcase || g_ascii_isupper(sWord[0])) {
-                            casestr = g_ascii_strdown(sNewWord, -1);
-                            if (strcmp(casestr, sNewWord)) {
-                                if (oLib[iLib]->Lookup(casestr, iWordIndices))
-                                    bFound = true;
-                            }
-                            g_free(casestr);
-                        }
-                        if (!bFound)
-                            sNewWord[iWordLen - 4] = sNewWord[iWordLen - 5]; // restore
-                    }
+                    else
+                        sNewWord[iWordLen - 4] = sNewWord[iWordLen - 5]; // restore
                 }
                 if (!bFound) {
-                    if (oLib[iLib]->Lookup(sNewWord, iWordIndices))
+                    if (lookup_stem(sNewWord, isupcase || g_ascii_isupper(sWord[0])))
                         bFound = true;
-                    else if (isupcase || g_ascii_isupper(sWord[0])) {
-                        casestr = g_ascii_strdown(sNewWord, -1);
-                        if (strcmp(casestr, sNewWord)) {
-                            if (oLib[iLib]->Lookup(casestr, iWordIndices))
-                                bFound = true;
-                        }
-                        g_free(casestr);
-                    }
                 }
                 if (!bFound) {
                     if (isupcase)
                         strcat(sNewWord, "E"); // add a char "E"
                     else
                         strcat(sNewWord, "e"); // add a char "e"
-                    if (oLib[iLib]->Lookup(sNewWord, iWordIndices))
+                    if (lookup_stem(sNewWord, isupcase || g_ascii_isupper(sWord[0])))
                         bFound = true;
-                    else if (isupcase || g_ascii_isupper(sWord[0])) {
-                        casestr = g_ascii_strdown(sNewWord, -1);
-                        if (strcmp(casestr, sNewWord)) {
-                            if (oLib[iLib]->Lookup(casestr, iWordIndices))
-                                bFound = true;
-                        }
-                        g_free(casestr);
-                    }
                 }
             }
         }
@@ -1187,16 +1653,8 @@ bool Libs::LookupSimilarWord(const gchar *sWord, std::set<glong> &iWordIndices,
             if (isupcase || (!strncmp(&sWord[iWordLen - 2], "es", 2) && (sWord[iWordLen - 3] == 's' || sWord[iWordLen - 3] == 'x' || sWord[iWordLen - 3] == 'o' || (iWordLen > 4 && sWord[iWordLen - 3] == 'h' && (sWord[iWordLen - 4] == 'c' || sWord[iWordLen - 4] == 's'))))) {
                 strcpy(sNewWord, sWord);
                 sNewWord[iWordLen - 2] = '\0';
-                if (oLib[iLib]->Lookup(sNewWord, iWordIndices))
+                if (lookup_stem(sNewWord, isupcase || g_ascii_isupper(sWord[0])))
                     bFound = true;
-                else if (isupcase || g_ascii_isupper(sWord[0])) {
-                    casestr = g_ascii_strdown(sNewWord, -1);
-                    if (strcmp(casestr, sNewWord)) {
-                        if (oLib[iLib]->Lookup(casestr, iWordIndices))
-                            bFound = true;
-                    }
-                    g_free(casestr);
-                }
             }
         }
 
@@ -1209,32 +1667,14 @@ bool Libs::LookupSimilarWord(const gchar *sWord, std::set<glong> &iWordIndices,
                 if (iWordLen > 5 && (sNewWord[iWordLen - 3] == sNewWord[iWordLen - 4])
                     && !bIsVowel(sNewWord[iWordLen - 4]) && bIsVowel(sNewWord[iWordLen - 5])) { // doubled
                     sNewWord[iWordLen - 3] = '\0';
-                    if (oLib[iLib]->Lookup(sNewWord, iWordIndices))
+                    if (lookup_stem(sNewWord, isupcase || g_ascii_isupper(sWord[0])))
                         bFound = true;
-                    else {
-                        if (isupcase || g_ascii_isupper(sWord[0])) {
-                            casestr = g_ascii_strdown(sNewWord, -1);
-                            if (strcmp(casestr, sNewWord)) {
-                                if (oLib[iLib]->Lookup(casestr, iWordIndices))
-                                    bFound = true;
-                            }
-                            g_free(casestr);
-                        }
-                        if (!bFound)
-                            sNewWord[iWordLen - 3] = sNewWord[iWordLen - 4]; // restore
-                    }
+                    else
+                        sNewWord[iWordLen - 3] = sNewWord[iWordLen - 4]; // restore
                 }
                 if (!bFound) {
-                    if (oLib[iLib]->Lookup(sNewWord, iWordIndices))
+                    if (lookup_stem(sNewWord, isupcase || g_ascii_isupper(sWord[0])))
                         bFound = true;
-                    else if (isupcase || g_ascii_isupper(sWord[0])) {
-                        casestr = g_ascii_strdown(sNewWord, -1);
-                        if (strcmp(casestr, sNewWord)) {
-                            if (oLib[iLib]->Lookup(casestr, iWordIndices))
-                                bFound = true;
-                        }
-                        g_free(casestr);
-                    }
                 }
             }
         }
@@ -1249,16 +1689,8 @@ bool Libs::LookupSimilarWord(const gchar *sWord, std::set<glong> &iWordIndices,
                     strcat(sNewWord, "Y"); // add a char "Y"
                 else
                     strcat(sNewWord, "y"); // add a char "y"
-                if (oLib[iLib]->Lookup(sNewWord, iWordIndices))
+                if (lookup_stem(sNewWord, isupcase || g_ascii_isupper(sWord[0])))
                     bFound = true;
-                else if (isupcase || g_ascii_isupper(sWord[0])) {
-                    casestr = g_ascii_strdown(sNewWord, -1);
-                    if (strcmp(casestr, sNewWord)) {
-                        if (oLib[iLib]->Lookup(casestr, iWordIndices))
-                            bFound = true;
-                    }
-                    g_free(casestr);
-                }
             }
         }
 
@@ -1272,16 +1704,8 @@ bool Libs::LookupSimilarWord(const gchar *sWord, std::set<glong> &iWordIndices,
                     strcat(sNewWord, "Y"); // add a char "Y"
                 else
                     strcat(sNewWord, "y"); // add a char "y"
-                if (oLib[iLib]->Lookup(sNewWord, iWordIndices))
+                if (lookup_stem(sNewWord, isupcase || g_ascii_isupper(sWord[0])))
                     bFound = true;
-                else if (isupcase || g_ascii_isupper(sWord[0])) {
-                    casestr = g_ascii_strdown(sNewWord, -1);
-                    if (strcmp(casestr, sNewWord)) {
-                        if (oLib[iLib]->Lookup(casestr, iWordIndices))
-                            bFound = true;
-                    }
-                    g_free(casestr);
-                }
             }
         }
 
@@ -1291,16 +1715,8 @@ bool Libs::LookupSimilarWord(const gchar *sWord, std::set<glong> &iWordIndices,
             if (isupcase || (!strncmp(&sWord[iWordLen - 2], "er", 2))) {
                 strcpy(sNewWord, sWord);
                 sNewWord[iWordLen - 2] = '\0';
-                if (oLib[iLib]->Lookup(sNewWord, iWordIndices))
+                if (lookup_stem(sNewWord, isupcase || g_ascii_isupper(sWord[0])))
                     bFound = true;
-                else if (isupcase || g_ascii_isupper(sWord[0])) {
-                    casestr = g_ascii_strdown(sNewWord, -1);
-                    if (strcmp(casestr, sNewWord)) {
-                        if (oLib[iLib]->Lookup(casestr, iWordIndices))
-                            bFound = true;
-                    }
-                    g_free(casestr);
-                }
             }
         }
 
@@ -1310,21 +1726,17 @@ bool Libs::LookupSimilarWord(const gchar *sWord, std::set<glong> &iWordIndices,
             if (isupcase || (!strncmp(&sWord[iWordLen - 3], "est", 3))) {
                 strcpy(sNewWord, sWord);
                 sNewWord[iWordLen - 3] = '\0';
-                if (oLib[iLib]->Lookup(sNewWord, iWordIndices))
+                if (lookup_stem(sNewWord, isupcase || g_ascii_isupper(sWord[0])))
                     bFound = true;
-                else if (isupcase || g_ascii_isupper(sWord[0])) {
-                    casestr = g_ascii_strdown(sNewWord, -1);
-                    if (strcmp(casestr, sNewWord)) {
-                        if (oLib[iLib]->Lookup(casestr, iWordIndices))
-                            bFound = true;
-                    }
-                    g_free(casestr);
-                }
             }
         }
 
         g_free(sNewWord);
     }
+
+    // the last chance before fuzzy search, word typed without accents
+    if (!bFound)
+        bFound = oLib[iLib]->LookupWithoutMarks(sWord, iWordIndices);
 #if 0
     else {
         //don't change iWordIndex here.
@@ -1335,6 +1747,27 @@ bool Libs::LookupSimilarWord(const gchar *sWord, std::set<glong> &iWordIndices,
     return bFound;
 }
 
+void Libs::LookupWords(const std::vector<const gchar *> &words, std::vector<std::vector<std::set<glong>>> &found)
+{
+    std::vector<size_t> order(words.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&words](size_t lh, size_t rh) {
+        return stardict_strcmp(words[lh], words[rh]) < 0;
+    });
+    std::vector<const gchar *> sorted_words(words.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        sorted_words[i] = words[order[i]];
+
+    found.assign(ndicts(), std::vector<std::set<glong>>(words.size()));
+    pool_->parallel_for(ndicts(), [this, &order, &sorted_words, &found](size_t iLib) {
+        std::vector<std::set<glong>> sorted_found(sorted_words.size());
+        oLib[iLib]->Lookup(sorted_words.data(), sorted_words.size(), sorted_found);
+        for (size_t i = 0; i < order.size(); ++i)
+            found[iLib][order[i]] = std::move(sorted_found[i]);
+    });
+}
+
 bool Libs::SimpleLookupWord(const gchar *sWord, std::set<glong> &iWordIndices, int iLib)
 {
     bool bFound = oLib[iLib]->Lookup(sWord, iWordIndices);
@@ -1343,30 +1776,175 @@ bool Libs::SimpleLookupWord(const gchar *sWord, std::set<glong> &iWordIndices, i
     return bFound;
 }
 
-bool Libs::LookupWithFuzzy(const gchar *sWord, gchar *reslist[], gint reslist_size)
+// collects every checked word of dictionary which could get into the list of best matches
+// with some limit of distance, i.e. with the loosest one. Words are compared in lower case
+// and the longer word is cut to the length of sWord.
+class FuzzyCollector
 {
-    if (sWord[0] == '\0')
-        return false;
+public:
+    FuzzyCollector(Dict &dict, size_t iLib, const gunichar *ucs4_str2, glong ucs4_str2_len,
+                   int iMaxDistance, std::vector<Fuzzystruct> &res)
+        : dict_(dict)
+        , iLib_(iLib)
+        , ucs4_str2_(ucs4_str2)
+        , ucs4_str2_len_(ucs4_str2_len)
+        , iMaxDistance_(iMaxDistance)
+        , res_(res)
+    {
+    }
+    // words should be checked in ascending order of index
+    void check(glong index);
 
-    Fuzzystruct oFuzzystruct[reslist_size];
+private:
+    Dict &dict_;
+    size_t iLib_;
+    const gunichar *ucs4_str2_;
+    glong ucs4_str2_len_;
+    int iMaxDistance_;
+    std::vector<Fuzzystruct> &res_;
+    EditDistance oEditDistance_;
+};
+
+void FuzzyCollector::check(glong index)
+{
+    const gchar *sCheck = dict_.get_key(index);
+    // tolower and skip too long or too short words
+    const glong iCheckWordLen = g_utf8_strlen(sCheck, -1);
+    if (iCheckWordLen - ucs4_str2_len_ >= iMaxDistance_ || ucs4_str2_len_ - iCheckWordLen >= iMaxDistance_)
+        return;
+    gunichar *ucs4_str1 = g_utf8_to_ucs4_fast(sCheck, -1, nullptr);
+    if (iCheckWordLen > ucs4_str2_len_)
+        ucs4_str1[ucs4_str2_len_] = 0;
+    unicode_strdown(ucs4_str1);
+
+    // distance less than limit does not depend on the limit
+    const int iDistance = oEditDistance_.CalEditDistance(ucs4_str1, ucs4_str2_, iMaxDistance_);
+    g_free(ucs4_str1);
+    // when ucs4_str2_len=1,2 we need less fuzzy.
+    if (iDistance >= iMaxDistance_ || iDistance >= ucs4_str2_len_)
+        return;
+    const glong iLenDif = iCheckWordLen > ucs4_str2_len_ ? iCheckWordLen - ucs4_str2_len_ : ucs4_str2_len_ - iCheckWordLen;
+    res_.push_back(Fuzzystruct{ iDistance, int(iLenDif), (guint64(iLib_) << 32) | guint64(index) });
+}
 
-    for (int i = 0; i < reslist_size; i++) {
-        oFuzzystruct[i].pMatchWord = nullptr;
-        oFuzzystruct[i].iMatchWordDistance = iMaxFuzzyDistance;
+// list of reslist_size best matches, the words should be added in order of dictionaries
+// and indexes. It gives the same words as the old sequential search: the list starts
+// with empty slots of distance iMaxDistance, a word is taken if it is better than the worst
+// slot and not in the list yet, and it replaces the last of the worst slots. Slots are kept
+// in a max-heap of distance and number of slot, so the worst slot is at the top.
+// A word takes one slot, but its places in all dictionaries are kept in the slot.
+class FuzzyList
+{
+public:
+    FuzzyList(Libs &libs, int iMaxDistance, size_t reslist_size)
+        : libs_(libs)
+        , iMaxDistance_(iMaxDistance)
+    {
+        for (size_t i = 0; i < reslist_size; ++i)
+            slots_.push_back(Slot{ iMaxDistance, i, std::string() });
+        std::make_heap(slots_.begin(), slots_.end());
+        positions_.resize(reslist_size);
     }
-    int iMaxDistance = iMaxFuzzyDistance;
-    int iDistance;
-    bool Found = false;
-    EditDistance oEditDistance;
+    void add(const Fuzzystruct &match);
+    // found words sorted by distance
+    void get_words(std::vector<WordPos> &words) const;
 
-    glong iCheckWordLen;
-    const char *sCheck;
-    gunichar *ucs4_str1, *ucs4_str2;
-    glong ucs4_str2_len;
+private:
+    struct Slot {
+        int iDistance;
+        size_t iSlot;
+        // empty slot has no word
+        std::string sWord;
+
+        bool operator<(const Slot &rh) const
+        {
+            if (iDistance != rh.iDistance)
+                return iDistance < rh.iDistance;
+            return iSlot < rh.iSlot;
+        }
+    };
+
+    Libs &libs_;
+    int iMaxDistance_;
+    std::vector<Slot> slots_;
+    // dictionaries and indexes of the word of every slot, one for every dictionary
+    std::vector<std::vector<guint64>> positions_;
+    // slots of words in the list
+    std::unordered_map<std::string, size_t> words_;
+};
 
-    ucs4_str2 = g_utf8_to_ucs4_fast(sWord, -1, &ucs4_str2_len);
+void FuzzyList::add(const Fuzzystruct &match)
+{
+    if (slots_.empty())
+        return;
+    std::string sWord(libs_.poGetWord(match.index(), match.iLib()));
+    // the same word of other dictionary has the same distance, but the list
+    // could be filled with such distances after the word was taken
+    auto it = words_.find(sWord);
+    if (it != words_.end()) {
+        std::vector<guint64> &positions = positions_[it->second];
+        if (int(positions.back() >> 32) != match.iLib())
+            positions.push_back(match.iPos);
+        return;
+    }
+    if (match.iLenDif >= iMaxDistance_ || match.iMatchWordDistance >= iMaxDistance_)
+        return;
+
+    std::pop_heap(slots_.begin(), slots_.end());
+    Slot &slot = slots_.back();
+    if (!slot.sWord.empty())
+        words_.erase(slot.sWord);
+    words_.emplace(sWord, slot.iSlot);
+    positions_[slot.iSlot].assign(1, match.iPos);
+    slot.iDistance = match.iMatchWordDistance;
+    slot.sWord = std::move(sWord);
+    std::push_heap(slots_.begin(), slots_.end());
+    iMaxDistance_ = slots_.front().iDistance;
+}
+
+void FuzzyList::get_words(std::vector<WordPos> &words) const
+{
+    std::vector<const Slot *> found;
+    for (const Slot &slot : slots_)
+        if (!slot.sWord.empty())
+            found.push_back(&slot);
+    // sort with distance
+    std::sort(found.begin(), found.end(), [](const Slot *lh, const Slot *rh) -> bool {
+        if (lh->iDistance != rh->iDistance)
+            return lh->iDistance < rh->iDistance;
+
+        return stardict_strcmp(lh->sWord.c_str(), rh->sWord.c_str()) < 0;
+    });
+    words.clear();
+    for (const Slot *slot : found)
+        for (guint64 iPos : positions_[slot->iSlot])
+            words.emplace_back(int(iPos >> 32), glong(iPos & 0xFFFFFFFF));
+}
+
+bool Libs::LookupWithFuzzy(const gchar *sWord, std::vector<WordPos> &words)
+{
+    words.clear();
+    if (sWord[0] == '\0')
+        return false;
+
+    glong ucs4_str2_len;
+    gunichar *ucs4_str2 = g_utf8_to_ucs4_fast(sWord, -1, &ucs4_str2_len);
     unicode_strdown(ucs4_str2);
 
+    // fuzzy index gives a short list of words to check
+    std::vector<std::vector<glong>> candidates(oLib.size());
+    std::unique_ptr<bool[]> have_candidates(new bool[oLib.size()]);
+    const int iMaxDistance = std::min<glong>(iMaxFuzzyDistance, ucs4_str2_len);
+    pool().parallel_for(oLib.size(), [&](size_t iLib) {
+        have_candidates[iLib] = oLib[iLib]->LookupFuzzyCandidates(ucs4_str2, ucs4_str2_len, iMaxDistance, candidates[iLib]);
+    });
+
+    struct FuzzyChunk {
+        size_t iLib;
+        glong from, to;
+        std::vector<Fuzzystruct> res;
+    };
+    std::vector<FuzzyChunk> chunks;
     for (size_t iLib = 0; iLib < oLib.size(); ++iLib) {
         if (progress_func)
             progress_func();
@@ -1374,108 +1952,103 @@ bool Libs::LookupWithFuzzy(const gchar *sWord, gchar *reslist[], gint reslist_si
         // if (stardict_strcmp(sWord, poGetWord(0,iLib))>=0 && stardict_strcmp(sWord, poGetWord(narticles(iLib)-1,iLib))<=0) {
         // there are Chinese dicts and English dicts...
 
-        const int iwords = narticles(iLib);
-        for (int index = 0; index < iwords; index++) {
-            sCheck = poGetWord(index, iLib);
-            // tolower and skip too long or too short words
-            iCheckWordLen = g_utf8_strlen(sCheck, -1);
-            if (iCheckWordLen - ucs4_str2_len >= iMaxDistance || ucs4_str2_len - iCheckWordLen >= iMaxDistance)
-                continue;
-            ucs4_str1 = g_utf8_to_ucs4_fast(sCheck, -1, nullptr);
-            if (iCheckWordLen > ucs4_str2_len)
-                ucs4_str1[ucs4_str2_len] = 0;
-            unicode_strdown(ucs4_str1);
-
-            iDistance = oEditDistance.CalEditDistance(ucs4_str1, ucs4_str2, iMaxDistance);
-            g_free(ucs4_str1);
-            if (iDistance < iMaxDistance && iDistance < ucs4_str2_len) {
-                // when ucs4_str2_len=1,2 we need less fuzzy.
-                Found = true;
-                bool bAlreadyInList = false;
-                int iMaxDistanceAt = 0;
-                for (int j = 0; j < reslist_size; j++) {
-                    if (oFuzzystruct[j].pMatchWord && strcmp(oFuzzystruct[j].pMatchWord, sCheck) == 0) { // already in list
-                        bAlreadyInList = true;
-                        break;
-                    }
-                    // find the position,it will certainly be found (include the first time) as iMaxDistance is set by last time.
-                    if (oFuzzystruct[j].iMatchWordDistance == iMaxDistance) {
-                        iMaxDistanceAt = j;
-                    }
-                }
-                if (!bAlreadyInList) {
-                    if (oFuzzystruct[iMaxDistanceAt].pMatchWord)
-                        g_free(oFuzzystruct[iMaxDistanceAt].pMatchWord);
-                    oFuzzystruct[iMaxDistanceAt].pMatchWord = g_strdup(sCheck);
-                    oFuzzystruct[iMaxDistanceAt].iMatchWordDistance = iDistance;
-                    // calc new iMaxDistance
-                    iMaxDistance = iDistance;
-                    for (int j = 0; j < reslist_size; j++) {
-                        if (oFuzzystruct[j].iMatchWordDistance > iMaxDistance)
-                            iMaxDistance = oFuzzystruct[j].iMatchWordDistance;
-                    } // calc new iMaxDistance
-                } // add to list
-            } // find one
-        } // each word
-
-    } // each lib
-    g_free(ucs4_str2);
-
-    if (Found) // sort with distance
-        std::sort(oFuzzystruct, oFuzzystruct + reslist_size, [](const Fuzzystruct &lh, const Fuzzystruct &rh) -> bool {
-            if (lh.iMatchWordDistance != rh.iMatchWordDistance)
-                return lh.iMatchWordDistance < rh.iMatchWordDistance;
-
-            if (lh.pMatchWord && rh.pMatchWord)
-                return stardict_strcmp(lh.pMatchWord, rh.pMatchWord) < 0;
+        // without fuzzy index every word is checked, [from, to) is range of indexes,
+        // otherwise it is range in the list of candidates
+        const glong iwords = have_candidates[iLib] ? candidates[iLib].size() : narticles(iLib);
+        for (glong from = 0; from < iwords; from += FUZZY_CHUNK_SIZE)
+            chunks.push_back(FuzzyChunk{ iLib, from, std::min(iwords, from + FUZZY_CHUNK_SIZE), {} });
+    }
 
-            return false;
-        });
+    // every part keeps all words which could get into the list with the loosest limit,
+    // the list is made from them in order of dictionaries and indexes as by one thread
+    pool().parallel_for(chunks.size(), [&](size_t i) {
+        FuzzyChunk &chunk = chunks[i];
+        FuzzyCollector collector(*oLib[chunk.iLib], chunk.iLib, ucs4_str2, ucs4_str2_len,
+                                 iMaxFuzzyDistance, chunk.res);
+        for (glong j = chunk.from; j < chunk.to; ++j)
+            collector.check(have_candidates[chunk.iLib] ? candidates[chunk.iLib][j] : j);
+    });
+    g_free(ucs4_str2);
 
-    for (gint i = 0; i < reslist_size; ++i)
-        reslist[i] = oFuzzystruct[i].pMatchWord;
+    FuzzyList list(*this, iMaxFuzzyDistance, fuzzy_limit_);
+    for (const FuzzyChunk &chunk : chunks)
+        for (const Fuzzystruct &match : chunk.res)
+            list.add(match);
+    std::vector<WordPos> found;
+    list.get_words(found);
+
+    for (const WordPos &pos : found) {
+        std::set<glong> idxs;
+        oLib[pos.first]->get_same_words(pos.second, idxs);
+        for (glong idx : idxs)
+            words.emplace_back(pos.first, idx);
+    }
 
-    return Found;
+    return !words.empty();
 }
 
-gint Libs::LookupWithRule(const gchar *word, gchar **ppMatchWord)
+gint Libs::LookupWithRule(const gchar *word, std::vector<WordPos> &words)
 {
     glong aiIndex[MAX_MATCH_ITEM_PER_LIB + 1];
-    gint iMatchCount = 0;
     GPatternSpec *pspec = g_pattern_spec_new(word);
+    std::vector<std::pair<std::string, WordPos>> matches;
 
     for (std::vector<Dict *>::size_type iLib = 0; iLib < oLib.size(); iLib++) {
-        // if(oLibs.LookdupWordsWithRule(pspec,aiIndex,MAX_MATCH_ITEM_PER_LIB+1-iMatchCount,iLib))
-        //  -iMatchCount,so save time,but may got less result and the word may repeat.
-
-        if (oLib[iLib]->LookupWithRule(pspec, aiIndex, MAX_MATCH_ITEM_PER_LIB + 1)) {
+        if (oLib[iLib]->LookupWithRule(word, pspec, aiIndex, MAX_MATCH_ITEM_PER_LIB + 1)) {
             if (progress_func)
                 progress_func();
-            for (int i = 0; aiIndex[i] != -1; i++) {
-                const gchar *sMatchWord = poGetWord(aiIndex[i], iLib);
-                bool bAlreadyInList = false;
-                for (int j = 0; j < iMatchCount; j++) {
-                    if (strcmp(ppMatchWord[j], sMatchWord) == 0) { // already in list
-                        bAlreadyInList = true;
-                        break;
-                    }
-                }
-                if (!bAlreadyInList)
-                    ppMatchWord[iMatchCount++] = g_strdup(sMatchWord);
-            }
+            for (int i = 0; aiIndex[i] != -1; i++)
+                matches.emplace_back(poGetWord(aiIndex[i], iLib), WordPos(iLib, aiIndex[i]));
         }
     }
     g_pattern_spec_free(pspec);
 
-    if (iMatchCount) // sort it.
-        std::sort(ppMatchWord, ppMatchWord + iMatchCount, [](const char *lh, const char *rh) -> bool {
-            return stardict_strcmp(lh, rh) < 0;
-        });
+    // the same word of several dictionaries goes together in order of dictionaries
+    std::stable_sort(matches.begin(), matches.end(), [](const std::pair<std::string, WordPos> &lh,
+                                                        const std::pair<std::string, WordPos> &rh) -> bool {
+        return stardict_strcmp(lh.first.c_str(), rh.first.c_str()) < 0;
+    });
+    words.clear();
+    for (const auto &match : matches)
+        words.push_back(match.second);
+
+    return words.size();
+}
+
+gint Libs::LookupWithPrefix(const gchar *prefix, std::vector<WordPos> &words)
+{
+    std::vector<std::vector<std::pair<std::string, glong>>> found(oLib.size());
+    pool().parallel_for(oLib.size(), [this, prefix, &found](size_t iLib) {
+        oLib[iLib]->LookupWithPrefix(prefix, MAX_MATCH_ITEM_PER_LIB, found[iLib]);
+    });
+    if (progress_func)
+        progress_func();
+
+    // every dictionary gives its first words, so the first of all of them are among them
+    std::vector<std::pair<std::string, WordPos>> matches;
+    for (size_t iLib = 0; iLib < found.size(); ++iLib)
+        for (auto &match : found[iLib])
+            matches.emplace_back(std::move(match.first), WordPos(iLib, match.second));
+    // the same word of several dictionaries goes together in order of dictionaries
+    std::stable_sort(matches.begin(), matches.end(), [](const std::pair<std::string, WordPos> &lh,
+                                                        const std::pair<std::string, WordPos> &rh) -> bool {
+        return stardict_strcmp(lh.first.c_str(), rh.first.c_str()) < 0;
+    });
+    words.clear();
+    gint nwords = 0;
+    for (size_t i = 0; i < matches.size(); ++i) {
+        if (i == 0 || matches[i].first != matches[i - 1].first) {
+            if (nwords == MAX_MATCH_ITEM_PER_LIB)
+                break;
+            ++nwords;
+        }
+        words.push_back(matches[i].second);
+    }
 
-    return iMatchCount;
+    return nwords;
 }
 
-bool Libs::LookupData(const gchar *sWord, std::vector<gchar *> *reslist)
+bool Libs::LookupData(const gchar *sWord, std::vector<WordPos> &words)
 {
     std::vector<std::string> SearchWords;
     std::string SearchWord;
@@ -1516,34 +2089,58 @@ bool Libs::LookupData(const gchar *sWord, std::vector<gchar *> *reslist)
     if (SearchWords.empty())
         return false;
 
-    guint32 max_size = 0;
-    gchar *origin_data = nullptr;
-    for (std::vector<Dict *>::size_type i = 0; i < oLib.size(); ++i) {
+    const MultiMatcher matcher(SearchWords);
+    std::vector<std::vector<DataEntry>> entries(oLib.size());
+    pool().parallel_for(oLib.size(), [this, &SearchWords, &entries](size_t i) {
+        if (!oLib[i]->containSearchData())
+            return;
+        // articles from index still should be checked
+        std::vector<glong> idxs;
+        if (data_index_ && oLib[i]->LookupDataCandidates(SearchWords, idxs)) {
+            entries[i].resize(idxs.size());
+            for (size_t j = 0; j < idxs.size(); ++j)
+                entries[i][j].idx = idxs[j];
+        } else {
+            entries[i].resize(narticles(i));
+            for (size_t j = 0; j < entries[i].size(); ++j)
+                entries[i][j].idx = j;
+        }
+        // articles are read in order of file
+        oLib[i]->get_data_entries(entries[i]);
+    });
+
+    struct DataChunk {
+        size_t iLib;
+        size_t from, to;
+    };
+    std::vector<DataChunk> chunks;
+    for (size_t i = 0; i < oLib.size(); ++i) {
         if (!oLib[i]->containSearchData())
             continue;
         if (progress_func)
             progress_func();
-        const gulong iwords = narticles(i);
-        const gchar *key;
-        guint32 offset, size;
-        for (gulong j = 0; j < iwords; ++j) {
-            oLib[i]->get_key_and_data(j, &key, &offset, &size);
-            if (size > max_size) {
-                origin_data = (gchar *)g_realloc(origin_data, size);
-                max_size = size;
-            }
-            if (oLib[i]->SearchData(SearchWords, offset, size, origin_data))
-                reslist[i].push_back(g_strdup(key));
+        for (size_t from = 0; from < entries[i].size();) {
+            const size_t to = next_data_chunk(entries[i], from);
+            chunks.push_back({ i, from, to });
+            from = to;
         }
     }
-    g_free(origin_data);
 
-    std::vector<Dict *>::size_type i;
-    for (i = 0; i < oLib.size(); ++i)
-        if (!reslist[i].empty())
-            break;
-
-    return i != oLib.size();
+    std::vector<std::vector<glong>> found(chunks.size());
+    pool().parallel_for(chunks.size(), [this, &matcher, &entries, &chunks, &found](size_t i) {
+        const DataChunk &chunk = chunks[i];
+        const DataEntry *dict_entries = entries[chunk.iLib].data();
+        oLib[chunk.iLib]->SearchData(matcher, dict_entries + chunk.from, dict_entries + chunk.to, found[i]);
+    });
+
+    // chunks go in order of dictionaries, so sorting by place sorts only indexes
+    words.clear();
+    for (size_t i = 0; i < chunks.size(); ++i)
+        for (glong idx : found[i])
+            words.emplace_back(chunks[i].iLib, idx);
+    std::sort(words.begin(), words.end());
+
+    return !words.empty();
 }
 
 /**************************************************/
@@ -1563,6 +2160,11 @@ query_t analyze_query(const char *s, std::string &res)
         return qtDATA;
     }
 
+    if (*s == '^') {
+        res = s + 1;
+        return qtPREFIX;
+    }
+
     bool regexp = false;
     const char *p = s;
     res = "";
@@ -2,16 +2,28 @@
 
 #include <cstring>
 #include <functional>
+#include <initializer_list>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "data_index.hpp"
 #include "dictziplib.hpp"
+#include "fold_index.hpp"
+#include "fuzzy_index.hpp"
+#include "hash_index.hpp"
+#include "key_offsets.hpp"
+#include "multi_matcher.hpp"
+#include "suffix_index.hpp"
+#include "thread_pool.hpp"
+#include "trie_index.hpp"
 
 const int MAX_MATCH_ITEM_PER_LIB = 100;
 const int MAX_FUZZY_DISTANCE = 3; // at most MAX_FUZZY_DISTANCE-1 differences allowed when find similar words
+const int MAX_FUZZY_WORDS = 10; // default number of words found by fuzzy search
 
 inline guint32 get_uint32(const gchar *addr)
 {
@@ -36,17 +48,21 @@ struct cacheItem {
 const int WORDDATA_CACHE_NUM = 10;
 const int INVALID_INDEX = -100;
 
+//place of article in dictionary file
+struct DataEntry {
+    guint32 offset;
+    guint32 size;
+    glong idx;
+};
+
 class DictBase
 {
 public:
     DictBase() {}
-    ~DictBase()
-    {
-        if (dictfile)
-            fclose(dictfile);
-    }
+    ~DictBase();
     DictBase(const DictBase &) = delete;
     DictBase &operator=(const DictBase &) = delete;
+    // returned data should be freed with g_free
     gchar *GetWordData(guint32 idxitem_offset, guint32 idxitem_size);
     bool containSearchData() const
     {
@@ -54,16 +70,28 @@ public:
             return true;
         return sametypesequence.find_first_of("mlgxty") != std::string::npos;
     }
-    bool SearchData(std::vector<std::string> &SearchWords, guint32 idxitem_offset, guint32 idxitem_size, gchar *origin_data);
+    //find articles which contain all words of matcher, entries should be sorted by offset,
+    //they are read in one piece, so every compressed chunk is inflated only once
+    void SearchData(const MultiMatcher &matcher, const DataEntry *begin, const DataEntry *end, std::vector<glong> &found);
 
 protected:
     std::string sametypesequence;
-    FILE *dictfile = nullptr;
+    int dictfd = -1;
     std::unique_ptr<DictData> dictdzfile;
 
+    //call fn with data of every article of entries, they should be sorted by offset
+    void read_articles(const DataEntry *begin, const DataEntry *end,
+                       const std::function<void(const DataEntry &, const gchar *)> &fn);
+    //call fn for text fields of article, which are searched by SearchData,
+    //until it returns true, returns true if fn did it
+    bool for_each_text_field(const gchar *data, guint32 size, const std::function<bool(const gchar *, guint32)> &fn) const;
+
 private:
     cacheItem cache[WORDDATA_CACHE_NUM];
     gint cache_cur = 0;
+    std::mutex cache_mutex;
+
+    void read_data(gchar *buf, guint32 offset, guint32 size);
 };
 
 // this structure contain all information about dictionary
@@ -84,17 +112,16 @@ struct DictInfo {
     bool load_from_ifo_file(const std::string &ifofilename, bool istreedict);
 };
 
+//all methods except load can be called from several threads at once,
+//returned key is valid until the next call from the same thread
 class IIndexFile
 {
 public:
-    guint32 wordentry_offset;
-    guint32 wordentry_size;
-
     virtual ~IIndexFile() {}
     virtual bool load(const std::string &url, gulong wc, off_t fsize, bool verbose) = 0;
     virtual const gchar *get_key(glong idx) = 0;
-    virtual void get_data(glong idx) = 0;
-    virtual const gchar *get_key_and_data(glong idx) = 0;
+    virtual void get_data(glong idx, guint32 *offset, guint32 *size) = 0;
+    virtual const gchar *get_key_and_data(glong idx, guint32 *offset, guint32 *size) = 0;
     virtual bool lookup(const char *str, std::set<glong> &idxs, glong &next_idx) = 0;
     virtual bool lookup(const char *str, std::set<glong> &idxs)
     {
@@ -111,11 +138,18 @@ public:
     bool load(const std::string &url, gulong wc);
     bool lookup(const char *str, std::set<glong> &idxs, glong &next_idx);
     bool lookup(const char *str, std::set<glong> &idxs);
-    const gchar *get_key(glong idx) { return synlist[idx]; }
+    //indexes of words for every of strs sorted by stardict_strcmp, see Dict::Lookup
+    void lookup(const char *const *strs, size_t nstrs, std::vector<std::set<glong>> &found);
+    //add to words up to max_words synonyms starting with prefix, see Dict::LookupWithPrefix
+    void lookup_prefix(const char *prefix, size_t max_words, std::vector<std::pair<std::string, glong>> &words);
+    const gchar *get_key(glong idx) { return synlist.key(idx); }
+    //index of article of synonym
+    glong get_word_index(glong idx) { return g_ntohl(get_uint32(synlist.data(idx))); }
+    glong nwords() const { return synlist.size() > 0 ? synlist.size() - 1 : 0; }
 
 private:
     MapFile synfile;
-    std::vector<gchar *> synlist;
+    KeyOffsets synlist;
 };
 
 class Dict : public DictBase
@@ -124,45 +158,137 @@ public:
     Dict() {}
     Dict(const Dict &) = delete;
     Dict &operator=(const Dict &) = delete;
-    bool load(const std::string &ifofilename, bool verbose);
+    //if lazy, only .ifo is read and other files are opened at first use
+    bool load(const std::string &ifofilename, bool verbose, bool lazy = false);
+    //the same, but .ifo was already read
+    bool load(const DictInfo &dict_info, bool verbose, bool lazy = false);
+    //open files if it was not done by load, false if they can not be opened
+    bool open()
+    {
+        std::call_once(open_once, [this]() { opened = open_files(); });
+        return opened;
+    }
 
-    gulong narticles() const { return wordcount; }
+    gulong narticles() { return open() ? wordcount : 0; }
     const std::string &dict_name() const { return bookname; }
     const std::string &ifofilename() const { return ifo_file_name; }
+    //exact lookups use HashIndex, it is built at first lookup
+    void set_hash_index(bool use) { use_hash_index = use; }
+    //exact lookups without hash index and lookups of words with prefix
+    //use TrieIndex, it is built at first lookup
+    void set_trie_index(bool use) { use_trie_index = use; }
+    //compressed data is inflated with this pool
+    void set_thread_pool(ThreadPool *pool)
+    {
+        thread_pool = pool;
+        if (dictdzfile)
+            dictdzfile->set_thread_pool(pool);
+    }
 
     const gchar *get_key(glong index) { return idx_file->get_key(index); }
     gchar *get_data(glong index)
     {
-        idx_file->get_data(index);
-        return DictBase::GetWordData(idx_file->wordentry_offset, idx_file->wordentry_size);
+        guint32 offset, size;
+        idx_file->get_data(index, &offset, &size);
+        return DictBase::GetWordData(offset, size);
     }
     void get_key_and_data(glong index, const gchar **key, guint32 *offset, guint32 *size)
     {
-        *key = idx_file->get_key_and_data(index);
-        *offset = idx_file->wordentry_offset;
-        *size = idx_file->wordentry_size;
+        *key = idx_file->get_key_and_data(index, offset, size);
     }
     bool Lookup(const char *str, std::set<glong> &idxs, glong &next_idx);
-    bool Lookup(const char *str, std::set<glong> &idxs)
-    {
-        glong unused_next_idx;
-        return Lookup(str, idxs, unused_next_idx);
-    }
+    //the same without next_idx, it can use hash or trie index, see set_hash_index
+    bool Lookup(const char *str, std::set<glong> &idxs);
+    //ways to change case of letters of word, see LookupCaseForms
+    enum CaseForm { cfSAME, cfLOWER, cfUPPER, cfTITLE };
+    //add to idxs indexes of the first of forms of str which is in dictionary:
+    //str itself, in lower case, in upper case, or with the first letter in upper
+    //case and others in lower case. All forms are found with one probe: forms of
+    //ASCII word are next to each other in index, others are found with FoldIndex
+    bool LookupCaseForms(const char *str, std::initializer_list<CaseForm> forms, std::set<glong> &idxs);
+    //add to idxs indexes of words which are equal to str ignoring case, diacritical
+    //marks and compatibility forms of characters, see FoldIndex::fold_marks
+    bool LookupWithoutMarks(const char *str, std::set<glong> &idxs);
+    //the same as Lookup for every of strs, found[i] gets indexes for strs[i];
+    //strs should be sorted by stardict_strcmp, then index is walked only once
+    void Lookup(const char *const *strs, size_t nstrs, std::vector<std::set<glong>> &found);
 
-    bool LookupWithRule(GPatternSpec *pspec, glong *aIndex, int iBuffLen);
+    //indexes of the first iBuffLen - 1 words matching pspec made from pattern, -1 is after them;
+    //only words starting with the literal prefix of pattern or ending with its suffix are read
+    bool LookupWithRule(const gchar *pattern, GPatternSpec *pspec, glong *aIndex, int iBuffLen);
+    //add to words the first max_words different words and the same number of synonyms,
+    //which start with prefix ignoring case of ASCII letters, in order of index; every
+    //word or synonym is added with index of its article, so all articles of word are there
+    void LookupWithPrefix(const char *prefix, size_t max_words, std::vector<std::pair<std::string, glong>> &words);
+    //add to idxs index and indexes of the same word next to it
+    void get_same_words(glong index, std::set<glong> &idxs);
+    //words which could be similar to str, see FuzzyIndex::lookup,
+    //false if fuzzy index is not available and all words should be checked
+    bool LookupFuzzyCandidates(const gunichar *str, glong len, int max_distance, std::vector<glong> &idxs);
+    //fill offsets and sizes of entries with indexes and sort them by offset
+    void get_data_entries(std::vector<DataEntry> &entries);
+    //articles which could contain all words, see DataIndex::lookup,
+    //false if data index is not available and all articles should be checked
+    bool LookupDataCandidates(const std::vector<std::string> &words, std::vector<glong> &idxs);
 
 private:
     std::string ifo_file_name;
+    std::string idx_file_name;
+    std::string dict_file_name;
     gulong wordcount;
     gulong syn_wordcount;
     std::string bookname;
+    off_t idxfilesize = 0;
+    bool verbose = false;
+    ThreadPool *thread_pool = nullptr;
+    std::once_flag open_once;
+    bool opened = false;
 
     std::unique_ptr<IIndexFile> idx_file;
     std::unique_ptr<SynFile> syn_file;
+    std::once_flag fuzzy_index_once;
+    std::unique_ptr<FuzzyIndex> fuzzy_index;
+    std::once_flag data_index_once;
+    std::unique_ptr<DataIndex> data_index;
+    std::once_flag suffix_index_once;
+    std::unique_ptr<SuffixIndex> suffix_index;
+    bool use_hash_index = false;
+    std::once_flag hash_index_once;
+    std::unique_ptr<HashIndex> hash_index;
+    bool use_trie_index = false;
+    std::once_flag trie_index_once;
+    std::unique_ptr<TrieIndex> trie_index;
+    std::once_flag case_index_once;
+    std::unique_ptr<FoldIndex> case_index;
+    std::once_flag marks_index_once;
+    std::unique_ptr<FoldIndex> marks_index;
+    std::string syn_file_name;
 
-    bool load_ifofile(const std::string &ifofilename, off_t &idxfilesize);
+    bool open_files();
+    //false if suffix index can not be built
+    bool load_suffix_index();
+    //false if hash index can not be built
+    bool load_hash_index();
+    //false if trie index can not be built
+    bool load_trie_index();
+    //start of range of words in index which start with len bytes of prefix
+    //ignoring case of ASCII letters, it is found with trie index if it is used
+    glong index_prefix_start(const char *prefix, size_t len);
+    //false if case index can not be built
+    bool load_case_index();
+    //false if index of words without marks can not be built
+    bool load_marks_index();
+    //load index with fold and suffix of cache to index
+    void load_fold_index(const FoldIndex::Fold &fold, const std::string &suffix, std::unique_ptr<FoldIndex> &index);
+    //add to idxs words and synonyms from ranges which match
+    bool lookup_ranges(const WordRanges &ranges, const std::function<bool(const gchar *)> &match, std::set<glong> &idxs);
+    //ranges of words which are equal to str ignoring case of ASCII letters
+    WordRanges ascii_case_ranges(const char *str);
 };
 
+//place of article: number of dictionary and index of word in it
+typedef std::pair<int, glong> WordPos;
+
 class Libs
 {
 public:
@@ -170,17 +296,52 @@ public:
     {
         progress_func = f;
         iMaxFuzzyDistance = MAX_FUZZY_DISTANCE; // need to read from cfg.
+        pool_.reset(new ThreadPool(1));
     }
     void setVerbose(bool verbose) { verbose_ = verbose; }
     void setFuzzy(bool fuzzy) { fuzzy_ = fuzzy; }
+    //number of words found by LookupWithFuzzy
+    void setFuzzyLimit(size_t limit) { fuzzy_limit_ = limit; }
+    void setThreads(unsigned nthreads)
+    {
+        pool_.reset(new ThreadPool(nthreads));
+        for (Dict *lib : oLib)
+            lib->set_thread_pool(pool_.get());
+    }
+    //use minimal perfect hash for exact lookups, see Dict::set_hash_index
+    void setHashIndex(bool hash_index)
+    {
+        hash_index_ = hash_index;
+        for (Dict *lib : oLib)
+            lib->set_hash_index(hash_index);
+    }
+    //use trie of words for exact and prefix lookups, see Dict::set_trie_index
+    void setTrieIndex(bool trie_index)
+    {
+        trie_index_ = trie_index;
+        for (Dict *lib : oLib)
+            lib->set_trie_index(trie_index);
+    }
+    //use inverted index of articles for data search
+    void setDataIndex(bool data_index) { data_index_ = data_index; }
+    //open files of dictionaries at first search in them, see Dict::load
+    void setLazy(bool lazy) { lazy_ = lazy; }
+    ThreadPool &pool() { return *pool_; }
     ~Libs();
     Libs(const Libs &) = delete;
     Libs &operator=(const Libs &) = delete;
 
     void load_dict(const std::string &url);
+    //dictionaries are loaded with several threads, see setThreads
     void load(const std::list<std::string> &dicts_dirs,
               const std::list<std::string> &order_list,
               const std::list<std::string> &disable_list);
+    //the same, but .ifo files of dictionaries were already read by load_dict_infos
+    void load(const std::vector<DictInfo> &dict_infos,
+              const std::list<std::string> &order_list,
+              const std::list<std::string> &disable_list);
+    //infos of all dictionaries in dicts_dirs, see DictCatalog
+    void load_dict_infos(const std::list<std::string> &dicts_dirs, std::vector<DictInfo> &dict_infos);
     glong narticles(int idict) const { return oLib[idict]->narticles(); }
     const std::string &dict_name(int idict) const { return oLib[idict]->dict_name(); }
     gint ndicts() const { return oLib.size(); }
@@ -189,6 +350,7 @@ public:
     {
         return oLib[iLib]->get_key(iIndex);
     }
+    // returned data should be freed with g_free
     gchar *poGetWordData(glong iIndex, int iLib)
     {
         if (iIndex == INVALID_INDEX)
@@ -199,12 +361,23 @@ public:
     {
         return oLib[iLib]->Lookup(sWord, iWordIndices);
     }
+    //the same as LookupWord for every of words in every dictionary, found[iLib][i] gets
+    //indexes for words[i]; words are sorted once and every index is walked once
+    void LookupWords(const std::vector<const gchar *> &words, std::vector<std::vector<std::set<glong>>> &found);
     bool LookupSimilarWord(const gchar *sWord, std::set<glong> &iWordIndices, int iLib);
     bool SimpleLookupWord(const gchar *sWord, std::set<glong> &iWordIndices, int iLib);
 
-    bool LookupWithFuzzy(const gchar *sWord, gchar *reslist[], gint reslist_size);
-    gint LookupWithRule(const gchar *sWord, gchar *reslist[]);
-    bool LookupData(const gchar *sWord, std::vector<gchar *> *reslist);
+    //places of the most similar words, see setFuzzyLimit, sorted by distance;
+    //every word is taken from one dictionary, with all its articles there
+    bool LookupWithFuzzy(const gchar *sWord, std::vector<WordPos> &words);
+    //places of words matching pattern sWord, sorted by word, then by dictionary
+    gint LookupWithRule(const gchar *sWord, std::vector<WordPos> &words);
+    //places of articles of the first MAX_MATCH_ITEM_PER_LIB words and synonyms of all
+    //dictionaries, which start with prefix, sorted by word, then by dictionary;
+    //only their ranges of indexes are read
+    gint LookupWithPrefix(const gchar *prefix, std::vector<WordPos> &words);
+    //places of articles containing all words of sWord, sorted by dictionary and index
+    bool LookupData(const gchar *sWord, std::vector<WordPos> &words);
 
 protected:
     bool fuzzy_;
@@ -214,13 +387,20 @@ private:
     int iMaxFuzzyDistance;
     std::function<void(void)> progress_func;
     bool verbose_;
+    std::unique_ptr<ThreadPool> pool_;
+    bool data_index_ = false;
+    bool hash_index_ = false;
+    bool trie_index_ = false;
+    bool lazy_ = false;
+    size_t fuzzy_limit_ = MAX_FUZZY_WORDS;
 };
 
 enum query_t {
     qtSIMPLE,
     qtREGEXP,
     qtFUZZY,
-    qtDATA
+    qtDATA,
+    qtPREFIX
 };
 
 extern query_t analyze_query(const char *s, std::string &res);
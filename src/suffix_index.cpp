@@ -0,0 +1,112 @@
+/*
+ * This file part of sdcv - console version of Stardict program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "stardict_lib.hpp"
+
+#include "suffix_index.hpp"
+
+namespace
+{
+const char SUFFIX_INDEX_MAGIC[] = "sdcv suffix index, version: 1\n";
+
+//compare the last len bytes of key (or all of them if it is shorter)
+//read from the end with reversed suffix of the same length
+int compare_ending(const gchar *key, const char *suffix, size_t len)
+{
+    const size_t key_len = strlen(key);
+    for (size_t i = 1; i <= len; ++i) {
+        if (i > key_len)
+            return -1;
+        const guchar a = key[key_len - i], b = suffix[len - i];
+        if (a != b)
+            return a < b ? -1 : 1;
+    }
+    return 0;
+}
+} // namespace
+
+bool SuffixIndex::load(const std::string &url, glong wordcount, const std::function<const gchar *(glong)> &get_key)
+{
+    const std::string magic(SUFFIX_INDEX_MAGIC);
+    if (cache_.load(url, ".sfi", magic) && attach(cache_.data(), cache_.size(), wordcount))
+        return true;
+
+    std::vector<std::pair<std::string, guint32>> words(wordcount);
+    for (glong i = 0; i < wordcount; ++i) {
+        const gchar *key = get_key(i);
+        words[i].first.assign(key, strlen(key));
+        std::reverse(words[i].first.begin(), words[i].first.end());
+        words[i].second = i;
+    }
+    std::sort(words.begin(), words.end());
+    buffer_.resize(wordcount);
+    for (glong i = 0; i < wordcount; ++i)
+        buffer_[i] = words[i].second;
+
+    CacheFile::save(url, ".sfi", magic, [this](FILE *out) {
+        return fwrite(&buffer_[0], sizeof(buffer_[0]), buffer_.size(), out) == buffer_.size();
+    });
+    return attach(reinterpret_cast<const gchar *>(&buffer_[0]), buffer_.size() * sizeof(buffer_[0]), wordcount);
+}
+
+bool SuffixIndex::attach(const gchar *data, size_t size, glong wordcount)
+{
+    if (size != guint64(wordcount) * sizeof(guint32))
+        return false;
+    // a bad cache should not give indexes out of range
+    for (size_t i = 0; i < size; i += sizeof(guint32))
+        if (get_uint32(data + i) >= guint64(wordcount))
+            return false;
+    idxs_ = data;
+    wordcount_ = wordcount;
+    return true;
+}
+
+inline glong SuffixIndex::idx(glong i) const
+{
+    return get_uint32(idxs_ + i * sizeof(guint32));
+}
+
+void SuffixIndex::lookup(const char *suffix, const std::function<const gchar *(glong)> &get_key, std::vector<glong> &idxs) const
+{
+    const size_t len = strlen(suffix);
+    glong from = 0, to = wordcount_;
+    while (from < to) {
+        const glong middle = from + (to - from) / 2;
+        if (compare_ending(get_key(idx(middle)), suffix, len) < 0)
+            from = middle + 1;
+        else
+            to = middle;
+    }
+    idxs.clear();
+    for (glong i = from; i < wordcount_; ++i) {
+        const glong j = idx(i);
+        if (compare_ending(get_key(j), suffix, len) != 0)
+            break;
+        idxs.push_back(j);
+    }
+    std::sort(idxs.begin(), idxs.end());
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include "cache_file.hpp"
+
+//indexes of words of dictionary sorted by words read from the end,
+//so words with the same ending are together and can be found with
+//binary search, it is used for patterns like "*ing"
+class SuffixIndex
+{
+public:
+    SuffixIndex() {}
+    SuffixIndex(const SuffixIndex &) = delete;
+    SuffixIndex &operator=(const SuffixIndex &) = delete;
+
+    //load from cache of url or build with get_key and save to cache
+    bool load(const std::string &url, glong wordcount, const std::function<const gchar *(glong)> &get_key);
+    //indexes of all words which end with suffix (case matters) in ascending order
+    void lookup(const char *suffix, const std::function<const gchar *(glong)> &get_key, std::vector<glong> &idxs) const;
+
+private:
+    CacheFile cache_;
+    std::vector<guint32> buffer_;
+    const gchar *idxs_ = nullptr;
+    glong wordcount_ = 0;
+
+    bool attach(const gchar *data, size_t size, glong wordcount);
+    glong idx(glong i) const;
+};
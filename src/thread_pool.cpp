@@ -0,0 +1,128 @@
+/*
+ * This file part of sdcv - console version of Stardict program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <atomic>
+#include <csignal>
+#include <exception>
+
+#include "thread_pool.hpp"
+
+struct ThreadPool::Batch {
+    const std::function<void(size_t)> &fn;
+    const size_t n;
+    std::atomic<size_t> next;
+    std::atomic<size_t> finished;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::exception_ptr error;
+
+    Batch(const std::function<void(size_t)> &fn_, size_t n_)
+        : fn(fn_)
+        , n(n_)
+        , next(0)
+        , finished(0)
+    {
+    }
+    void run();
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this]() { return finished == n; });
+    }
+};
+
+void ThreadPool::Batch::run()
+{
+    size_t i;
+    while ((i = next++) < n) {
+        try {
+            fn(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error)
+                error = std::current_exception();
+        }
+        if (++finished == n) {
+            std::lock_guard<std::mutex> lock(mutex);
+            cv.notify_all();
+        }
+    }
+}
+
+ThreadPool::ThreadPool(unsigned nthreads)
+{
+    // signals should be handled by the main thread only
+    sigset_t all_signals, old_mask;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_mask);
+    for (unsigned i = 1; i < nthreads; ++i)
+        workers_.emplace_back(&ThreadPool::worker, this);
+    pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (std::thread &t : workers_)
+        t.join();
+}
+
+void ThreadPool::parallel_for(size_t n, const std::function<void(size_t)> &fn)
+{
+    if (workers_.empty() || n <= 1) {
+        for (size_t i = 0; i < n; ++i)
+            fn(i);
+        return;
+    }
+
+    std::shared_ptr<Batch> batch(new Batch(fn, n));
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        batches_.push_back(batch);
+    }
+    cv_.notify_all();
+    batch->run();
+    batch->wait();
+    if (batch->error)
+        std::rethrow_exception(batch->error);
+}
+
+void ThreadPool::worker()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        cv_.wait(lock, [this]() { return stop_ || !batches_.empty(); });
+        if (stop_)
+            return;
+        std::shared_ptr<Batch> batch = batches_.front();
+        lock.unlock();
+        batch->run();
+        lock.lock();
+        // all items of batch are taken, it is time to look at the next one
+        if (!batches_.empty() && batches_.front() == batch)
+            batches_.pop_front();
+    }
+}
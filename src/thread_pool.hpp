@@ -0,0 +1,38 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//persistent set of worker threads, several threads can use
+//the same pool at once, calling thread also takes part in work
+class ThreadPool
+{
+public:
+    //nthreads includes calling thread, so 1 means no workers at all
+    explicit ThreadPool(unsigned nthreads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned size() const { return workers_.size() + 1; }
+    //call fn(0), ..., fn(n - 1) and wait until all of them return,
+    //the first exception thrown by fn is rethrown here
+    void parallel_for(size_t n, const std::function<void(size_t)> &fn);
+
+private:
+    struct Batch;
+
+    std::vector<std::thread> workers_;
+    std::deque<std::shared_ptr<Batch>> batches_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+
+    void worker();
+};
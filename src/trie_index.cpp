@@ -0,0 +1,420 @@
+/*
+ * This file part of sdcv - console version of Stardict program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstring>
+#include <deque>
+
+#include "stardict_lib.hpp"
+
+#include "trie_index.hpp"
+
+namespace
+{
+const char TRIE_INDEX_MAGIC[] = "sdcv trie index, version: 2\n";
+// header: number of nodes, number of words, wordcount, syn_wordcount
+const size_t HEADER_SIZE = 4;
+// number of ones before every block of so many bits is kept
+const guint32 BLOCK_BITS = 256;
+const guint32 BLOCK_WORDS = BLOCK_BITS / 32;
+
+guint32 nwords(guint32 nbits)
+{
+    return (nbits + 31) / 32;
+}
+
+guint32 nranks(guint32 nbits)
+{
+    return nwords(nbits) / BLOCK_WORDS + 1;
+}
+
+// places of parts of trie in units of guint32
+struct Layout {
+    size_t louds, louds_ranks, terminals, terminal_ranks, idx_counts, idx_count_ranks,
+        syn_counts, syn_count_ranks, labels, size;
+
+    // every word has one bit for each of its entries and zero bit after them
+    Layout(guint32 nnodes, guint32 idx_bits, guint32 syn_bits)
+    {
+        // every node except root has one bit in its parent
+        const guint32 nbits = 2 * nnodes - 1;
+        louds = HEADER_SIZE;
+        louds_ranks = louds + nwords(nbits);
+        terminals = louds_ranks + nranks(nbits);
+        terminal_ranks = terminals + nwords(nnodes);
+        idx_counts = terminal_ranks + nranks(nnodes);
+        idx_count_ranks = idx_counts + nwords(idx_bits);
+        syn_counts = idx_count_ranks + nranks(idx_bits);
+        syn_count_ranks = syn_counts + nwords(syn_bits);
+        labels = syn_count_ranks + nranks(syn_bits);
+        size = labels + (nnodes + 3) / 4;
+    }
+};
+
+guint32 popcount(guint32 x)
+{
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    x = (x + (x >> 4)) & 0x0f0f0f0f;
+    return (x * 0x01010101) >> 24;
+}
+
+inline guint32 word_at(const gchar *bits, guint32 i)
+{
+    return get_uint32(bits + i * sizeof(guint32));
+}
+
+// bits are appended to words one by one, then ranks are counted
+class BitsWriter
+{
+public:
+    void push(bool bit)
+    {
+        if (nbits_ % 32 == 0)
+            words_.push_back(0);
+        if (bit)
+            words_.back() |= 1u << (nbits_ % 32);
+        ++nbits_;
+    }
+    void write(guint32 *bits, guint32 *ranks) const
+    {
+        guint32 ones = 0;
+        for (guint32 w = 0; w < words_.size(); ++w) {
+            if (w % BLOCK_WORDS == 0)
+                ranks[w / BLOCK_WORDS] = ones;
+            bits[w] = words_[w];
+            ones += popcount(words_[w]);
+        }
+        if (words_.size() % BLOCK_WORDS == 0)
+            ranks[words_.size() / BLOCK_WORDS] = ones;
+    }
+
+private:
+    std::vector<guint32> words_;
+    guint32 nbits_ = 0;
+};
+
+// every so many zeros the block of the zero is kept
+const guint32 ZERO_SAMPLE = 256;
+} // namespace
+
+bool RankedBits::attach(const gchar *bits, const gchar *ranks, guint32 nbits)
+{
+    // ranks should be the same as written by BitsWriter, padding should be zero
+    guint32 ones = 0;
+    for (guint32 w = 0; w < nwords(nbits); ++w) {
+        if (w % BLOCK_WORDS == 0 && word_at(ranks, w / BLOCK_WORDS) != ones)
+            return false;
+        ones += popcount(word_at(bits, w));
+    }
+    if (nwords(nbits) % BLOCK_WORDS == 0 && word_at(ranks, nwords(nbits) / BLOCK_WORDS) != ones)
+        return false;
+    if (nbits % 32 != 0 && (word_at(bits, nbits / 32) >> (nbits % 32)) != 0)
+        return false;
+
+    // zeros before block are its bits without ones before it
+    std::vector<guint32> zero_blocks;
+    const guint32 nblocks = nranks(nbits);
+    for (guint32 block = 0; block < nblocks; ++block) {
+        const guint32 zeros_end = block + 1 < nblocks ? (block + 1) * BLOCK_BITS - word_at(ranks, block + 1)
+                                                      : nbits - ones;
+        while (zero_blocks.size() * ZERO_SAMPLE < zeros_end)
+            zero_blocks.push_back(block);
+    }
+    zero_blocks.push_back(nblocks - 1);
+
+    bits_ = bits;
+    ranks_ = ranks;
+    zero_blocks_.swap(zero_blocks);
+    return true;
+}
+
+bool RankedBits::operator[](guint32 i) const
+{
+    return (word_at(bits_, i / 32) >> (i % 32)) & 1;
+}
+
+guint32 RankedBits::rank(guint32 i) const
+{
+    const guint32 block = i / BLOCK_BITS;
+    guint32 result = word_at(ranks_, block);
+    for (guint32 w = block * BLOCK_WORDS; w < i / 32; ++w)
+        result += popcount(word_at(bits_, w));
+    if (i % 32 != 0)
+        result += popcount(word_at(bits_, i / 32) & ((1u << (i % 32)) - 1));
+    return result;
+}
+
+guint32 RankedBits::select0(guint32 k) const
+{
+    // the last block with not more than k zeros before it,
+    // it is between blocks of sampled zeros around k
+    guint32 lo = zero_blocks_[k / ZERO_SAMPLE], hi = zero_blocks_[k / ZERO_SAMPLE + 1] + 1;
+    while (hi - lo > 1) {
+        const guint32 mid = lo + (hi - lo) / 2;
+        if (mid * BLOCK_BITS - word_at(ranks_, mid) <= k)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    k -= lo * BLOCK_BITS - word_at(ranks_, lo);
+    guint32 w = lo * BLOCK_WORDS;
+    for (;; ++w) {
+        const guint32 zeros = 32 - popcount(word_at(bits_, w));
+        if (k < zeros)
+            break;
+        k -= zeros;
+    }
+    guint32 x = ~word_at(bits_, w);
+    for (; k > 0; --k)
+        x &= x - 1;
+    guint32 i = w * 32;
+    for (; !(x & 1); x >>= 1)
+        ++i;
+    return i;
+}
+
+bool TrieIndex::load(const std::string &url, const std::list<std::string> &sources,
+                     glong wordcount, const std::function<const gchar *(glong)> &get_key,
+                     glong syn_wordcount, const std::function<const gchar *(glong)> &get_syn_key)
+{
+    const std::string magic(TRIE_INDEX_MAGIC);
+    if (cache_.load(url, ".trie", magic, sources) && attach(cache_.data(), cache_.size(), wordcount, syn_wordcount))
+        return true;
+
+    std::vector<std::pair<std::string, WordRanges>> words;
+    if (!collect_word_ranges(wordcount, get_key, syn_wordcount, get_syn_key, words))
+        return false;
+    build(words, wordcount, syn_wordcount, buffer_);
+    words.clear();
+    CacheFile::save(url, ".trie", magic, [this](FILE *out) {
+        return fwrite(&buffer_[0], sizeof(buffer_[0]), buffer_.size(), out) == buffer_.size();
+    });
+    return attach(reinterpret_cast<const gchar *>(&buffer_[0]), buffer_.size() * sizeof(buffer_[0]), wordcount, syn_wordcount);
+}
+
+void TrieIndex::build(const std::vector<std::pair<std::string, WordRanges>> &words,
+                      glong wordcount, glong syn_wordcount, std::vector<guint32> &buf)
+{
+    // node is range of sorted words with the same prefix of length depth
+    struct Node {
+        size_t from, to, depth;
+    };
+    std::deque<Node> queue{ Node{ 0, words.size(), 0 } };
+    BitsWriter louds, terminals;
+    std::vector<guchar> labels(1, 0);
+    while (!queue.empty()) {
+        const Node node = queue.front();
+        queue.pop_front();
+        size_t i = node.from;
+        // the word which ends here is the first one
+        const bool terminal = i < node.to && words[i].first.size() == node.depth;
+        terminals.push(terminal);
+        if (terminal)
+            ++i;
+        while (i < node.to) {
+            const char c = words[i].first[node.depth];
+            size_t j = i + 1;
+            while (j < node.to && words[j].first[node.depth] == c)
+                ++j;
+            queue.push_back(Node{ i, j, node.depth + 1 });
+            labels.push_back(c);
+            louds.push(true);
+            i = j;
+        }
+        louds.push(false);
+    }
+
+    BitsWriter idx_counts, syn_counts;
+    for (const auto &word : words) {
+        for (guint32 i = 0; i < word.second.idx_count; ++i)
+            idx_counts.push(true);
+        idx_counts.push(false);
+        for (guint32 i = 0; i < word.second.syn_count; ++i)
+            syn_counts.push(true);
+        syn_counts.push(false);
+    }
+
+    const guint32 nnodes = labels.size();
+    const Layout layout(nnodes, wordcount + words.size(), syn_wordcount + words.size());
+    buf.assign(layout.size, 0);
+    buf[0] = nnodes;
+    buf[1] = words.size();
+    buf[2] = wordcount;
+    buf[3] = syn_wordcount;
+    louds.write(&buf[layout.louds], &buf[layout.louds_ranks]);
+    terminals.write(&buf[layout.terminals], &buf[layout.terminal_ranks]);
+    idx_counts.write(&buf[layout.idx_counts], &buf[layout.idx_count_ranks]);
+    syn_counts.write(&buf[layout.syn_counts], &buf[layout.syn_count_ranks]);
+    memcpy(&buf[layout.labels], &labels[0], nnodes);
+}
+
+bool TrieIndex::attach(const gchar *data, size_t size, glong wordcount, glong syn_wordcount)
+{
+    if (size < HEADER_SIZE * sizeof(guint32))
+        return false;
+    const guint32 nnodes = get_uint32(data);
+    const guint32 nwords = get_uint32(data + sizeof(guint32));
+    const guint64 idx_bits = guint64(wordcount) + nwords;
+    const guint64 syn_bits = guint64(syn_wordcount) + nwords;
+    if (nnodes == 0 || nnodes >= (1u << 31) || nwords > nnodes || idx_bits > G_MAXUINT32 || syn_bits > G_MAXUINT32
+        || get_uint32(data + 2 * sizeof(guint32)) != guint32(wordcount)
+        || get_uint32(data + 3 * sizeof(guint32)) != guint32(syn_wordcount))
+        return false;
+    const Layout layout(nnodes, idx_bits, syn_bits);
+    if (size != layout.size * sizeof(guint32))
+        return false;
+
+    // a bad cache should not give nodes and places out of range
+    auto at = [data](size_t place) { return data + place * sizeof(guint32); };
+    const guint32 nbits = 2 * nnodes - 1;
+    if (!louds_.attach(at(layout.louds), at(layout.louds_ranks), nbits)
+        || !terminals_.attach(at(layout.terminals), at(layout.terminal_ranks), nnodes)
+        || terminals_.rank(nnodes) != nwords
+        || !idx_counts_.attach(at(layout.idx_counts), at(layout.idx_count_ranks), idx_bits)
+        || idx_counts_.rank(idx_bits) != guint32(wordcount)
+        || !syn_counts_.attach(at(layout.syn_counts), at(layout.syn_count_ranks), syn_bits)
+        || syn_counts_.rank(syn_bits) != guint32(syn_wordcount))
+        return false;
+    // children should go after their parent, so walk over trie ends;
+    // the first child of the first node of a level starts the next level
+    std::vector<guint32> levels(1, 0);
+    guint32 node = 0, child = 0;
+    bool node_start = true;
+    for (guint32 i = 0; i < nbits; ++i) {
+        if (node_start && node == levels.back())
+            levels.push_back(child + 1);
+        node_start = !louds_[i];
+        if (node_start)
+            ++node;
+        else if (++child <= node)
+            return false;
+    }
+    if (node != nnodes || child != nnodes - 1)
+        return false;
+
+    level_words_.clear();
+    for (guint32 level : levels)
+        level_words_.push_back(terminals_.rank(level));
+    nnodes_ = nnodes;
+    labels_ = at(layout.labels);
+    levels_.swap(levels);
+    return true;
+}
+
+guint32 TrieIndex::first_child(guint32 node) const
+{
+    // bits of node are after zero bit of the previous node,
+    // and there are node zeros before them
+    const guint32 from = node == 0 ? 0 : louds_.select0(node - 1) + 1;
+    return from - node + 1;
+}
+
+void TrieIndex::children(guint32 node, guint32 *first, guint32 *count) const
+{
+    *first = first_child(node);
+    *count = louds_.select0(node) + 1 - node - *first;
+}
+
+guint32 TrieIndex::child(guint32 node, guchar c) const
+{
+    guint32 lo, count;
+    children(node, &lo, &count);
+    const guint32 end = lo + count;
+    guint32 hi = end;
+    while (lo < hi) {
+        const guint32 mid = lo + (hi - lo) / 2;
+        if (label(mid) < c)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    // root is not a child of any node
+    return lo < end && label(lo) == c ? lo : 0;
+}
+
+bool TrieIndex::find(const char *prefix, guint32 *node, std::vector<guint32> &path) const
+{
+    *node = 0;
+    path.clear();
+    if (nnodes_ == 0)
+        return false;
+    for (const guchar *p = reinterpret_cast<const guchar *>(prefix); *p; ++p) {
+        path.push_back(*node);
+        if ((*node = child(*node, g_ascii_tolower(*p))) == 0)
+            return false;
+    }
+    return true;
+}
+
+guint32 TrieIndex::words_before(const std::vector<guint32> &path, guint32 node) const
+{
+    // nodes of a level are in the same order as their words, so words before node
+    // are words of ancestors and of nodes before them at their levels, of nodes
+    // before node at its level and of children of nodes before them at next levels
+    guint32 result = 0;
+    size_t level = 0;
+    for (; level < path.size(); ++level)
+        result += terminals_.rank(path[level] + 1) - level_words_[level];
+    for (; node > levels_[level]; ++level) {
+        // all nodes of next levels go before
+        if (node == levels_[level + 1])
+            return result + level_words_.back() - level_words_[level];
+        result += terminals_.rank(node) - level_words_[level];
+        node = first_child(node);
+    }
+    return result;
+}
+
+WordRanges TrieIndex::word_ranges(guint32 first, guint32 end) const
+{
+    // entries before word are ones before its zero bit
+    auto entries_before = [](const RankedBits &counts, guint32 word) -> guint32 {
+        return word == 0 ? 0 : counts.select0(word - 1) - (word - 1);
+    };
+    WordRanges ranges;
+    ranges.idx_from = entries_before(idx_counts_, first);
+    ranges.idx_count = entries_before(idx_counts_, end) - ranges.idx_from;
+    ranges.syn_from = entries_before(syn_counts_, first);
+    ranges.syn_count = entries_before(syn_counts_, end) - ranges.syn_from;
+    return ranges;
+}
+
+WordRanges TrieIndex::lookup(const char *str) const
+{
+    guint32 node;
+    std::vector<guint32> path;
+    if (!find(str, &node, path) || !terminals_[node])
+        return WordRanges{ 0, 0, 0, 0 };
+    // the word of node goes before words of its children
+    const guint32 word = words_before(path, node);
+    return word_ranges(word, word + 1);
+}
+
+WordRanges TrieIndex::lookup_prefix(const char *prefix) const
+{
+    guint32 node;
+    std::vector<guint32> path;
+    if (!find(prefix, &node, path))
+        return WordRanges{ 0, 0, 0, 0 };
+    // words under node go before words under next node of its level
+    return word_ranges(words_before(path, node), words_before(path, node + 1));
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include "cache_file.hpp"
+#include "word_ranges.hpp"
+
+//bits with number of ones before every block of them, which are kept in cache,
+//and blocks with every 256th zero bit, which are found when the cache is checked
+class RankedBits
+{
+public:
+    //false if ranks do not match bits
+    bool attach(const gchar *bits, const gchar *ranks, guint32 nbits);
+    bool operator[](guint32 i) const;
+    //number of ones before bit i
+    guint32 rank(guint32 i) const;
+    //place of zero bit with number k, there should be so many zeros
+    guint32 select0(guint32 k) const;
+
+private:
+    const gchar *bits_ = nullptr;
+    const gchar *ranks_ = nullptr;
+    std::vector<guint32> zero_blocks_;
+};
+
+//trie of words and synonyms of dictionary with ASCII letters in lower case,
+//every word in it gives WordRanges. The trie is stored as LOUDS: nodes are
+//numbered in breadth first order, every node has one bit for each child and
+//zero bit after them, so with its label a node takes about 11 bits, and
+//children are found with counts of bits instead of pointers. Children are
+//sorted by label, so words in the trie are in the same order as in index:
+//number of the word in this order is counted with nodes which go before it
+//at every level, and its ranges are found with this number in bits which
+//have count of its entries in unary code, so no ranges are kept for words.
+class TrieIndex
+{
+public:
+    TrieIndex() {}
+    TrieIndex(const TrieIndex &) = delete;
+    TrieIndex &operator=(const TrieIndex &) = delete;
+
+    //load from cache of url or build with get_key and get_syn_key and save to cache,
+    //sources are other files of dictionary which the cache depends on;
+    //false if index and synonyms are not sorted
+    bool load(const std::string &url, const std::list<std::string> &sources,
+              glong wordcount, const std::function<const gchar *(glong)> &get_key,
+              glong syn_wordcount, const std::function<const gchar *(glong)> &get_syn_key);
+    //ranges of words which are equal to str ignoring case of ASCII letters,
+    //empty if there is no such word
+    WordRanges lookup(const char *str) const;
+    //ranges of all words which start with prefix ignoring case of ASCII letters,
+    //they are next to each other in index and in synonyms; empty if there is no such word
+    WordRanges lookup_prefix(const char *prefix) const;
+
+private:
+    CacheFile cache_;
+    std::vector<guint32> buffer_;
+    guint32 nnodes_ = 0;
+    RankedBits louds_, terminals_, idx_counts_, syn_counts_;
+    const gchar *labels_ = nullptr;
+    //first node of every level and number of nodes at the end,
+    //and number of words before every of them
+    std::vector<guint32> levels_, level_words_;
+
+    bool attach(const gchar *data, size_t size, glong wordcount, glong syn_wordcount);
+    static void build(const std::vector<std::pair<std::string, WordRanges>> &words,
+                      glong wordcount, glong syn_wordcount, std::vector<guint32> &buf);
+    //first child of node, or where it would be if node has no children
+    guint32 first_child(guint32 node) const;
+    //first child of node and number of children
+    void children(guint32 node, guint32 *first, guint32 *count) const;
+    //child of node with label c, 0 if there is no such child
+    guint32 child(guint32 node, guchar c) const;
+    guchar label(guint32 node) const { return labels_[node]; }
+    //node which all words with prefix are under and its ancestors from root,
+    //false if there is no such node
+    bool find(const char *prefix, guint32 *node, std::vector<guint32> &path) const;
+    //number of words before node in order of index, path is ancestors of node
+    guint32 words_before(const std::vector<guint32> &path, guint32 node) const;
+    //ranges of words with numbers from first to last one before end
+    WordRanges word_ranges(guint32 first, guint32 end) const;
+};
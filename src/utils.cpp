@@ -25,10 +25,9 @@
 #include <algorithm>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <glib.h>
 #include <glib/gi18n.h>
-#include <iomanip>
-#include <sstream>
 
 #include "utils.hpp"
 
@@ -55,10 +54,65 @@ std::string utf8_to_locale_ign_err(const std::string &utf8_str)
     return res;
 }
 
+std::string utf8_make_valid(const std::string &str)
+{
+    std::string res;
+    const gchar *p = str.data();
+    const gchar *end = p + str.size();
+    while (p < end) {
+        const gchar *valid_end;
+        g_utf8_validate(p, end - p, &valid_end);
+        res.append(p, valid_end);
+        p = valid_end;
+        if (p < end) {
+            // replacement character instead of the bad byte
+            res += "\xEF\xBF\xBD";
+            ++p;
+        }
+    }
+
+    return res;
+}
+
+std::string locale_to_utf8_ign_err(const std::string &locale_str)
+{
+    const char *charset;
+    if (g_get_charset(&charset))
+        return utf8_make_valid(locale_str);
+
+    std::string res;
+    const gchar *p = locale_str.data();
+    const gchar *end = p + locale_str.size();
+    while (p < end) {
+        // '\0' is a bad byte too
+        const gchar *nul = static_cast<const gchar *>(memchr(p, '\0', end - p));
+        const gsize len = (nul != nullptr ? nul : end) - p;
+        // on error bytes_read is the length of the part which can be converted
+        gsize bytes_read = 0;
+        glib::CharStr tmp(g_convert(p, len, "UTF-8", charset, &bytes_read, nullptr, nullptr));
+        if (nullptr == get_impl(tmp) && bytes_read > 0)
+            tmp.reset(g_convert(p, bytes_read, "UTF-8", charset, nullptr, nullptr, nullptr));
+        if (nullptr == get_impl(tmp))
+            bytes_read = 0;
+        else
+            res += get_impl(tmp);
+        p += bytes_read;
+        if (p < end) {
+            res += "\xEF\xBF\xBD";
+            ++p;
+        }
+    }
+
+    return res;
+}
+
 static void __for_each_file(const std::string &dirname, const std::string &suff,
                             const std::list<std::string> &order_list, const std::list<std::string> &disable_list,
-                            const std::function<void(const std::string &, bool)> &f)
+                            const std::function<void(const std::string &, bool)> &f,
+                            const std::function<void(const std::string &)> &on_dir)
 {
+    if (on_dir)
+        on_dir(dirname);
     GDir *dir = g_dir_open(dirname.c_str(), 0, nullptr);
     if (dir) {
         const gchar *filename;
@@ -66,7 +120,7 @@ static void __for_each_file(const std::string &dirname, const std::string &suff,
         while ((filename = g_dir_read_name(dir)) != nullptr) {
             const std::string fullfilename(dirname + G_DIR_SEPARATOR_S + filename);
             if (g_file_test(fullfilename.c_str(), G_FILE_TEST_IS_DIR))
-                __for_each_file(fullfilename, suff, order_list, disable_list, f);
+                __for_each_file(fullfilename, suff, order_list, disable_list, f, on_dir);
             else if (g_str_has_suffix(filename, suff.c_str()) && std::find(order_list.begin(), order_list.end(), fullfilename) == order_list.end()) {
                 const bool disable = std::find(disable_list.begin(),
                                                disable_list.end(),
@@ -81,51 +135,58 @@ static void __for_each_file(const std::string &dirname, const std::string &suff,
 
 void for_each_file(const std::list<std::string> &dirs_list, const std::string &suff,
                    const std::list<std::string> &order_list, const std::list<std::string> &disable_list,
-                   const std::function<void(const std::string &, bool)> &f)
+                   const std::function<void(const std::string &, bool)> &f,
+                   const std::function<void(const std::string &)> &on_dir)
 {
     for (const std::string &item : order_list) {
         const bool disable = std::find(disable_list.begin(), disable_list.end(), item) != disable_list.end();
         f(item, disable);
     }
     for (const std::string &item : dirs_list)
-        __for_each_file(item, suff, order_list, disable_list, f);
+        __for_each_file(item, suff, order_list, disable_list, f, on_dir);
 }
 
 // based on https://stackoverflow.com/questions/7724448/simple-json-string-escape-for-c/33799784#33799784
-std::string json_escape_string(const std::string &s)
+void append_json_escaped(std::string &out, const std::string &s)
 {
-    std::ostringstream o;
     for (auto c = s.cbegin(); c != s.cend(); c++) {
         switch (*c) {
         case '"':
-            o << "\\\"";
+            out += "\\\"";
             break;
         case '\\':
-            o << "\\\\";
+            out += "\\\\";
             break;
         case '\b':
-            o << "\\b";
+            out += "\\b";
             break;
         case '\f':
-            o << "\\f";
+            out += "\\f";
             break;
         case '\n':
-            o << "\\n";
+            out += "\\n";
             break;
         case '\r':
-            o << "\\r";
+            out += "\\r";
             break;
         case '\t':
-            o << "\\t";
+            out += "\\t";
             break;
         default:
             if ('\x00' <= *c && *c <= '\x1f') {
-                o << "\\u"
-                  << std::hex << std::setw(4) << std::setfill('0') << (int)*c;
+                char buf[sizeof("\\u0000")];
+                snprintf(buf, sizeof(buf), "\\u%04x", (int)*c);
+                out += buf;
             } else {
-                o << *c;
+                out += *c;
             }
         }
     }
-    return o.str();
+}
+
+std::string json_escape_string(const std::string &s)
+{
+    std::string res;
+    append_json_escaped(res, s);
+    return res;
 }
@@ -71,8 +71,16 @@ typedef ResourceWrapper<GError, GError, g_error_free> Error;
 } // namespace glib
 
 extern std::string utf8_to_locale_ign_err(const std::string &utf8_str);
+//bytes which are not valid in UTF-8 or in current locale are replaced with U+FFFD
+extern std::string utf8_make_valid(const std::string &str);
+extern std::string locale_to_utf8_ign_err(const std::string &locale_str);
 
+//call f for files with suffix suff in dirs_list and their subdirectories,
+//on_dir is called for every directory which is walked, even if it does not exist
 extern void for_each_file(const std::list<std::string> &dirs_list, const std::string &suff,
                           const std::list<std::string> &order_list, const std::list<std::string> &disable_list,
-                          const std::function<void(const std::string &, bool)> &f);
+                          const std::function<void(const std::string &, bool)> &f,
+                          const std::function<void(const std::string &)> &on_dir = std::function<void(const std::string &)>());
 extern std::string json_escape_string(const std::string &str);
+//the same as out += json_escape_string(str), but without temporary strings
+extern void append_json_escaped(std::string &out, const std::string &str);
@@ -0,0 +1,66 @@
+/*
+ * This file part of sdcv - console version of Stardict program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "word_ranges.hpp"
+
+bool collect_word_ranges(glong wordcount, const std::function<const gchar *(glong)> &get_key,
+                         glong syn_wordcount, const std::function<const gchar *(glong)> &get_syn_key,
+                         std::vector<std::pair<std::string, WordRanges>> &ranges)
+{
+    std::unordered_map<std::string, WordRanges> words;
+    auto add_ranges = [&words](glong count, const std::function<const gchar *(glong)> &get,
+                               guint32 WordRanges::*from, guint32 WordRanges::*size) {
+        WordRanges *entry = nullptr;
+        std::string prev;
+        for (glong i = 0; i < count; ++i) {
+            const gchar *key = get(i);
+            if (entry && g_ascii_strcasecmp(key, prev.c_str()) == 0) {
+                ++(entry->*size);
+                continue;
+            }
+            prev = key;
+            std::string word(prev);
+            for (char &c : word)
+                c = g_ascii_tolower(c);
+            entry = &words.emplace(word, WordRanges{ 0, 0, 0, 0 }).first->second;
+            // the same word in other place, index is not sorted
+            if (entry->*size != 0)
+                return false;
+            entry->*from = i;
+            entry->*size = 1;
+        }
+        return true;
+    };
+    if (!add_ranges(wordcount, get_key, &WordRanges::idx_from, &WordRanges::idx_count)
+        || !add_ranges(syn_wordcount, get_syn_key, &WordRanges::syn_from, &WordRanges::syn_count))
+        return false;
+
+    ranges.assign(words.begin(), words.end());
+    std::sort(ranges.begin(), ranges.end(), [](const std::pair<std::string, WordRanges> &lh,
+                                               const std::pair<std::string, WordRanges> &rh) {
+        return lh.first < rh.first;
+    });
+    return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glib.h>
+
+//words of dictionary which are equal ignoring case of ASCII letters. They are
+//next to each other in index and in synonym file, because both are sorted by
+//stardict_strcmp, so two ranges are enough for all of them.
+struct WordRanges {
+    guint32 idx_from, idx_count;
+    guint32 syn_from, syn_count;
+};
+
+//ranges of all words with ASCII letters in lower case, sorted by these words;
+//false if index or synonyms are not sorted
+bool collect_word_ranges(glong wordcount, const std::function<const gchar *(glong)> &get_key,
+                         glong syn_wordcount, const std::function<const gchar *(glong)> &get_syn_key,
+                         std::vector<std::pair<std::string, WordRanges>> &ranges);
@@ -0,0 +1,83 @@
+# common part of tests of caches which sdcv builds for dictionaries,
+# it is sourced by them after SDCV and TEST_DIR are set
+
+unset SDCV_PAGER
+unset STARDICT_DATA_DIR
+
+# dictionaries and caches are in temporary directory
+DICT_DIR=$(mktemp -d)
+trap 'rm -rf "$DICT_DIR"' EXIT
+export XDG_CACHE_HOME="$DICT_DIR/cache"
+
+# copy dictionaries from TEST_DIR
+copy_dicts() {
+    for dict in "$@"; do
+        cp -r "$TEST_DIR/$dict" "$DICT_DIR"
+    done
+}
+
+# sdcv should find words or return 2 if some of them are not found,
+# other return codes mean that it failed
+run_sdcv() {
+    RC=0
+    "$SDCV" "$@" || RC=$?
+    if [ "$RC" -ne 0 ] && [ "$RC" -ne 2 ]; then
+        echo "sdcv $* failed with return code $RC" >&2
+        return 1
+    fi
+}
+
+# change cache file $2 after its magic line, so it is rejected only by checks
+# of its content: cut the last byte, or write 0xff over 4 bytes at the start
+# or at the end of the content
+break_cache() {
+    MAGIC_SIZE=$(head -n 1 "$2" | wc -c)
+    SIZE=$(wc -c < "$2")
+    case "$1" in
+    cut)
+        dd if="$2" of="$2.cut" bs=1 count=$((SIZE - 1)) 2> /dev/null
+        mv "$2.cut" "$2"
+        ;;
+    head)
+        printf '\377\377\377\377' | dd of="$2" bs=1 seek="$MAGIC_SIZE" conv=notrunc 2> /dev/null
+        ;;
+    tail)
+        printf '\377\377\377\377' | dd of="$2" bs=1 seek=$((SIZE - 4)) conv=notrunc 2> /dev/null
+        ;;
+    esac
+}
+
+# cache files *$1 should be saved by the previous run of the rest of arguments,
+# which gave EXPECTED; the same is given with saved cache and with broken one,
+# which is built again
+check_cache() {
+    SUFFIX=$1
+    shift
+    if [ -z "$(find "$DICT_DIR" -name "*$SUFFIX")" ]; then
+        echo "cache $SUFFIX was not saved"
+        exit 1
+    fi
+    RESULT=$("$@")
+    if [ "$EXPECTED" != "$RESULT" ]; then
+        echo "results with saved cache $SUFFIX $RESULT differ from $EXPECTED"
+        exit 1
+    fi
+
+    find "$DICT_DIR" -name "*$SUFFIX" -exec sh -c 'echo garbage > "$1"' sh {} \;
+    RESULT=$("$@")
+    if [ "$EXPECTED" != "$RESULT" ]; then
+        echo "results with broken cache $SUFFIX $RESULT differ from $EXPECTED"
+        exit 1
+    fi
+
+    for HOW in cut head tail; do
+        for f in $(find "$DICT_DIR" -name "*$SUFFIX"); do
+            break_cache "$HOW" "$f"
+        done
+        RESULT=$("$@")
+        if [ "$EXPECTED" != "$RESULT" ]; then
+            echo "results with cache $SUFFIX broken by $HOW $RESULT differ from $EXPECTED"
+            exit 1
+        fi
+    done
+}